@@ -0,0 +1,352 @@
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <math.h>
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include "bench.h"
+
+#define CACHE_READ_MISS(cache) \
+    ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct counter_kind counter_kind_t;
+struct counter_kind
+{
+    /// @brief The name in the JSON results
+    const char *name;
+    /// @brief The column heading in the table
+    const char *heading;
+    uint32_t type;
+    uint64_t config;
+};
+
+static const counter_kind_t counter_kinds[] = {
+    {"cycles", "cycles/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", "instr/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"l1d_misses", "L1d miss/op", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_L1D)},
+    {"llc_misses", "LLC miss/op", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL)},
+    {"dtlb_misses", "dTLB miss/op", PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+    {"branch_misses", "br miss/op", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"page_faults", "faults/op", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+#define COUNTER_KINDS (sizeof(counter_kinds) / sizeof(counter_kinds[0]))
+
+/// @brief A counter value as read with PERF_FORMAT_TOTAL_TIME_ENABLED and
+///        PERF_FORMAT_TOTAL_TIME_RUNNING
+typedef struct counter_reading counter_reading_t;
+struct counter_reading
+{
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+typedef struct result result_t;
+struct result
+{
+    const char *name;
+    const char *param_name;
+    size_t param;
+    uint64_t iterations;
+    double median_ns;
+    double min_ns;
+    double max_ns;
+    /// @brief The median count per operation, NAN where unavailable
+    double counters[COUNTER_KINDS];
+};
+
+static const char *suite_name;
+static const bench_options_t *suite_options;
+static result_t *results = NULL;
+static size_t result_count = 0;
+/// @brief The counter file descriptors, -1 where unavailable
+static int counter_fds[COUNTER_KINDS];
+static bool any_counter = false;
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t bench_start(void)
+{
+    if (any_counter)
+    {
+        prctl(PR_TASK_PERF_EVENTS_ENABLE);
+    }
+    return bench_now_ns();
+}
+
+uint64_t bench_stop(uint64_t start)
+{
+    uint64_t elapsed = bench_now_ns() - start;
+    if (any_counter)
+    {
+        prctl(PR_TASK_PERF_EVENTS_DISABLE);
+    }
+    return elapsed;
+}
+
+/// @brief Open the counters disabled, so that they only count between
+///        bench_start and bench_stop
+static void open_counters(void)
+{
+    any_counter = false;
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        struct perf_event_attr attr = {
+            .size = sizeof(attr),
+            .type = counter_kinds[i].type,
+            .config = counter_kinds[i].config,
+            .disabled = 1,
+            .exclude_kernel = 1,
+            .exclude_hv = 1,
+            .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING,
+        };
+        counter_fds[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (counter_fds[i] < 0)
+        {
+            fprintf(stderr, "counter %s unavailable: %s\n", counter_kinds[i].name, strerror(errno));
+        }
+        any_counter = any_counter || counter_fds[i] >= 0;
+    }
+}
+
+static void close_counters(void)
+{
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        if (counter_fds[i] >= 0)
+        {
+            close(counter_fds[i]);
+        }
+    }
+    any_counter = false;
+}
+
+static void read_counters(counter_reading_t *readings)
+{
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        if (counter_fds[i] < 0 || read(counter_fds[i], &readings[i], sizeof(readings[i])) != sizeof(readings[i]))
+        {
+            readings[i] = (counter_reading_t){0};
+        }
+    }
+}
+
+/// @brief The count between two readings, scaled up if the kernel had to
+///        multiplex the counter with others
+/// @return NAN if the counter was enabled but never got scheduled
+static double counter_delta(counter_reading_t before, counter_reading_t after)
+{
+    uint64_t running = after.running - before.running;
+    if (running == 0)
+    {
+        return after.enabled == before.enabled ? 0 : NAN;
+    }
+    return (double)(after.value - before.value) * (after.enabled - before.enabled) / running;
+}
+
+bool bench_parse_options(int argc, char *argv[], bench_options_t *options)
+{
+    *options = (bench_options_t){.repeats = 5, .min_run_ns = 100000000, .max_iterations = 100000000};
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-f") == 0 && has_value)
+        {
+            options->filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "-o") == 0 && has_value)
+        {
+            options->output = argv[++i];
+        }
+        else if (strcmp(argv[i], "-r") == 0 && has_value && atoi(argv[i + 1]) > 0)
+        {
+            options->repeats = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-t") == 0 && has_value)
+        {
+            options->min_run_ns = strtoull(argv[++i], NULL, 10) * 1000000;
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-f filter] [-o output.json] [-r repeats] [-t min run ms]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+void bench_begin(const char *suite, const bench_options_t *options)
+{
+    suite_name = suite;
+    suite_options = options;
+    open_counters();
+    printf("%-28s %-16s %12s %14s %14s %14s", "case", "param", "iterations", "median ns/op", "min ns/op", "max ns/op");
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        if (counter_fds[i] >= 0)
+        {
+            printf(" %13s", counter_kinds[i].heading);
+        }
+    }
+    printf("\n");
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+/// @brief Find a number of iterations that takes at least the minimum run
+///        time, growing ten times at a time but not past what is needed.
+///        Cases with slow untimed setup stop growing once a run, setup
+///        included, takes the minimum run time.
+static uint64_t calibrate(size_t param, bench_fun_t fun)
+{
+    uint64_t iterations = 1;
+    for (;;)
+    {
+        uint64_t start = bench_now_ns();
+        uint64_t elapsed = fun(param, iterations);
+        uint64_t wall = bench_now_ns() - start;
+        if (elapsed >= suite_options->min_run_ns || wall >= 2 * suite_options->min_run_ns ||
+            iterations >= suite_options->max_iterations)
+        {
+            return iterations;
+        }
+        uint64_t needed = elapsed > 0
+                              ? (uint64_t)((double)iterations * suite_options->min_run_ns / elapsed * 1.2) + 1
+                              : iterations * 10;
+        uint64_t next = needed < iterations * 10 ? needed : iterations * 10;
+        iterations = next < suite_options->max_iterations ? next : suite_options->max_iterations;
+    }
+}
+
+void bench_run(const char *name, const char *param_name, size_t param, bench_fun_t fun)
+{
+    if (suite_options->filter && !strstr(name, suite_options->filter))
+    {
+        return;
+    }
+
+    uint64_t iterations = calibrate(param, fun);
+    int repeats = suite_options->repeats;
+    /* The time per operation of every repeat, followed by the count per
+       operation of every repeat for each counter */
+    double *ns_per_op = malloc((1 + COUNTER_KINDS) * repeats * sizeof(double));
+    result_t *grown = realloc(results, (result_count + 1) * sizeof(result_t));
+    if (!ns_per_op || !grown)
+    {
+        free(ns_per_op);
+        fprintf(stderr, "%s: out of memory\n", name);
+        return;
+    }
+    results = grown;
+    double *counts_per_op = ns_per_op + repeats;
+
+    for (int r = 0; r < repeats; r++)
+    {
+        counter_reading_t before[COUNTER_KINDS];
+        counter_reading_t after[COUNTER_KINDS];
+        read_counters(before);
+        ns_per_op[r] = (double)fun(param, iterations) / iterations;
+        read_counters(after);
+        for (size_t i = 0; i < COUNTER_KINDS; i++)
+        {
+            counts_per_op[i * repeats + r] = counter_delta(before[i], after[i]) / iterations;
+        }
+    }
+    qsort(ns_per_op, repeats, sizeof(double), compare_doubles);
+
+    result_t *result = &results[result_count++];
+    *result = (result_t){
+        .name = name,
+        .param_name = param_name,
+        .param = param,
+        .iterations = iterations,
+        .median_ns = repeats % 2 ? ns_per_op[repeats / 2]
+                                 : (ns_per_op[repeats / 2 - 1] + ns_per_op[repeats / 2]) / 2,
+        .min_ns = ns_per_op[0],
+        .max_ns = ns_per_op[repeats - 1],
+    };
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        double *counts = &counts_per_op[i * repeats];
+        qsort(counts, repeats, sizeof(double), compare_doubles);
+        result->counters[i] = counter_fds[i] < 0 ? NAN : counts[repeats / 2];
+    }
+    free(ns_per_op);
+
+    char param_text[64];
+    snprintf(param_text, sizeof(param_text), "%s=%zu", param_name, param);
+    printf("%-28s %-16s %12llu %14.1f %14.1f %14.1f", name, param_text,
+           (unsigned long long)iterations, result->median_ns, result->min_ns, result->max_ns);
+    for (size_t i = 0; i < COUNTER_KINDS; i++)
+    {
+        if (counter_fds[i] >= 0)
+        {
+            printf(" %13.2f", result->counters[i]);
+        }
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+bool bench_end(void)
+{
+    bool written = true;
+    if (suite_options->output)
+    {
+        FILE *out = fopen(suite_options->output, "w");
+        if (out)
+        {
+            fprintf(out, "{\n  \"suite\": \"%s\",\n  \"repeats\": %d,\n  \"benchmarks\": [", suite_name, suite_options->repeats);
+            for (size_t i = 0; i < result_count; i++)
+            {
+                result_t *r = &results[i];
+                fprintf(out, "%s\n    {\"name\": \"%s\", \"param\": \"%s\", \"value\": %zu, \"iterations\": %llu, "
+                             "\"ns_per_op\": %.3f, \"min_ns_per_op\": %.3f, \"max_ns_per_op\": %.3f",
+                        i ? "," : "", r->name, r->param_name, r->param, (unsigned long long)r->iterations,
+                        r->median_ns, r->min_ns, r->max_ns);
+                /* Only counters that were counted, JSON has no NaN */
+                bool counted = false;
+                for (size_t k = 0; k < COUNTER_KINDS; k++)
+                {
+                    if (!isnan(r->counters[k]))
+                    {
+                        fprintf(out, "%s\"%s\": %.3f", counted ? ", " : ", \"counters_per_op\": {",
+                                counter_kinds[k].name, r->counters[k]);
+                        counted = true;
+                    }
+                }
+                fprintf(out, counted ? "}}" : "}");
+            }
+            fprintf(out, "\n  ]\n}\n");
+            written = fclose(out) == 0;
+        }
+        else
+        {
+            perror(suite_options->output);
+            written = false;
+        }
+    }
+    free(results);
+    results = NULL;
+    result_count = 0;
+    close_counters();
+    return written;
+}
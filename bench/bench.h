@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @file bench.h
+ * @brief A small harness for refmem benchmarks.
+ *
+ * A benchmark case is a function that performs an operation a given number
+ * of times and returns how many nanoseconds the operations took, so that it
+ * can leave setup and teardown out of the measurement. It brackets the
+ * measured part with bench_start() and bench_stop(). The harness picks the
+ * number of iterations so that each run takes at least the minimum time,
+ * repeats the run, and reports the median, minimum and maximum time per
+ * operation.
+ *
+ * Where perf_event_open is allowed, the harness also counts cycles,
+ * instructions, L1 data cache, last level cache and dTLB read misses, branch
+ * misses and page faults in the measured parts, and reports the median of
+ * each per operation. Counters that cannot be opened, e.g. in a container
+ * or a virtual machine without a PMU, are left out.
+ *
+ * Results are printed as a table and, if an output file is given, written
+ * as JSON for bench/compare.py.
+ */
+
+/// @brief Run `iterations` operations
+/// @param param the parameter of the case, e.g. an object size
+/// @param iterations the number of operations to run
+/// @return the time the operations took in nanoseconds
+typedef uint64_t (*bench_fun_t)(size_t param, uint64_t iterations);
+
+typedef struct bench_options bench_options_t;
+struct bench_options
+{
+    /// @brief Only run cases whose name contains this string, NULL for all
+    const char *filter;
+    /// @brief Where to write the JSON results, NULL for none
+    const char *output;
+    /// @brief The number of timed runs per case
+    int repeats;
+    /// @brief The minimum duration of a timed run in nanoseconds
+    uint64_t min_run_ns;
+    /// @brief Never run more iterations than this, for slow setups
+    uint64_t max_iterations;
+};
+
+/// @brief Parse the command line options of a benchmark program:
+///        -f filter, -o output.json, -r repeats, -t min run time in ms
+/// @param argc as given to main
+/// @param argv as given to main
+/// @param options where the options are stored
+/// @return false, after printing usage, if the options are invalid
+bool bench_parse_options(int argc, char *argv[], bench_options_t *options);
+
+/// @brief Start a benchmark suite
+/// @param suite the name of the suite
+/// @param options the options of the suite, which must outlive it
+void bench_begin(const char *suite, const bench_options_t *options);
+
+/// @brief Measure one case
+/// @param name the name of the case
+/// @param param_name what the parameter is, e.g. "bytes"
+/// @param param the parameter passed to fun
+/// @param fun the case
+void bench_run(const char *name, const char *param_name, size_t param, bench_fun_t fun);
+
+/// @brief Finish the suite and write the JSON results
+/// @return false if the results could not be written
+bool bench_end(void);
+
+/// @brief A monotonic timestamp
+/// @return nanoseconds since an arbitrary point
+uint64_t bench_now_ns(void);
+
+/// @brief Start the measured part of a case, which also starts the counters
+/// @return the timestamp to pass to bench_stop
+uint64_t bench_start(void);
+
+/// @brief Stop the measured part of a case
+/// @param start as returned by bench_start
+/// @return the nanoseconds since bench_start
+uint64_t bench_stop(uint64_t start);
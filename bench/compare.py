@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Compare two JSON result files written by a bench program.
+
+Usage: bench/compare.py [--threshold PERCENT] baseline.json current.json
+
+Prints the change in median time per operation of every case found in
+both files, and exits with status 1 if any case got slower by more than
+the threshold (10% by default). A case only counts as a regression when
+its fastest run is also slower than the baseline's slowest run, so that
+noisy cases do not fail the comparison.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        results = json.load(f)
+    return {(b["name"], b["param"], b["value"]): b for b in results["benchmarks"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--threshold", type=float, default=10.0,
+                        help="allowed slowdown in percent (default 10)")
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+
+    regressions = 0
+    print(f"{'case':<28} {'param':<22} {'baseline ns':>14} {'current ns':>14} {'change':>9}")
+    for key, new in current.items():
+        old = baseline.get(key)
+        if old is None:
+            continue
+        name, param, value = key
+        change = (new["ns_per_op"] / old["ns_per_op"] - 1) * 100 if old["ns_per_op"] else 0.0
+        regressed = change > args.threshold and new["min_ns_per_op"] > old["max_ns_per_op"]
+        regressions += regressed
+        print(f"{name:<28} {param + '=' + str(value):<22} {old['ns_per_op']:>14.1f} "
+              f"{new['ns_per_op']:>14.1f} {change:>+8.1f}%{'  REGRESSION' if regressed else ''}")
+
+    for key in sorted(set(baseline) - set(current)):
+        print(f"{key[0]:<28} {key[1] + '=' + str(key[2]):<22} missing from {args.current}")
+
+    if regressions:
+        print(f"{regressions} regression(s) above {args.threshold:g}%")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
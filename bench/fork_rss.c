@@ -0,0 +1,242 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/refmem.h"
+#include "../src/refmem_internal.h"
+
+/**
+ * @file fork_rss.c
+ * @brief Measures how much of a pre-built heap a forked child copies when
+ * it retains and releases the objects, with and without refmem_freeze.
+ *
+ * The parent allocates the objects and fills their payloads, then forks a
+ * child that retains and releases every object once, as a worker using the
+ * heap would. The child reads its memory use from /proc/self/smaps_rollup
+ * before and after, so the private memory that the reference counts cost is
+ * the growth of Private_Dirty. The parent then freezes the heap and forks a
+ * second child that does the same.
+ *
+ * Usage: fork_rss [-n objects] [-b bytes per object] [-o output.json]
+ *
+ * The defaults are 20000 objects of 256 bytes. Linux only.
+ */
+
+typedef struct config config_t;
+struct config
+{
+    size_t objects;
+    size_t bytes;
+    const char *output;
+};
+
+/// @brief Memory use in kB, as in smaps_rollup
+typedef struct memory memory_t;
+struct memory
+{
+    long rss;
+    long shared;
+    long private_dirty;
+};
+
+typedef struct run run_t;
+struct run
+{
+    const char *mode;
+    memory_t before;
+    memory_t after;
+};
+
+static bool parse_options(int argc, char *argv[], config_t *config)
+{
+    *config = (config_t){.objects = 20000, .bytes = 256};
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-n") == 0 && has_value)
+        {
+            config->objects = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-b") == 0 && has_value)
+        {
+            config->bytes = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && has_value)
+        {
+            config->output = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-n objects] [-b bytes per object] [-o output.json]\n", argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Read the calling process's memory use
+/// @return false if smaps_rollup could not be read
+static bool read_memory(memory_t *memory)
+{
+    FILE *smaps = fopen("/proc/self/smaps_rollup", "r");
+    if (!smaps)
+    {
+        return false;
+    }
+    *memory = (memory_t){0};
+    char line[256];
+    while (fgets(line, sizeof(line), smaps))
+    {
+        long kb;
+        if (sscanf(line, "Rss: %ld", &kb) == 1)
+        {
+            memory->rss = kb;
+        }
+        else if (sscanf(line, "Shared_Clean: %ld", &kb) == 1 ||
+                 sscanf(line, "Shared_Dirty: %ld", &kb) == 1)
+        {
+            memory->shared += kb;
+        }
+        else if (sscanf(line, "Private_Dirty: %ld", &kb) == 1)
+        {
+            memory->private_dirty = kb;
+        }
+    }
+    fclose(smaps);
+    return true;
+}
+
+static void set_rc_to_one(object_t *object_struct, void *extra)
+{
+    object_struct->rc = 1;
+    obj ***next = extra;
+    *(*next)++ = object_struct->object;
+}
+
+/// @brief Fork a child that retains and releases every object once
+/// @param objects the objects
+/// @param count the number of objects
+/// @param run where the child's memory use before and after is stored
+/// @return false if the child could not be run or measured
+static bool measure_child(obj **objects, size_t count, run_t *run)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        return false;
+    }
+    if (pid == 0)
+    {
+        memory_t memory[2];
+        bool ok = read_memory(&memory[0]);
+        for (size_t i = 0; i < count; i++)
+        {
+            retain(objects[i]);
+            release(objects[i]);
+        }
+        ok = ok && read_memory(&memory[1]);
+        ok = ok && write(fds[1], memory, sizeof(memory)) == sizeof(memory);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    memory_t memory[2];
+    bool ok = read(fds[0], memory, sizeof(memory)) == sizeof(memory);
+    close(fds[0]);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!ok || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        return false;
+    }
+    run->before = memory[0];
+    run->after = memory[1];
+    return true;
+}
+
+static void print_report(const config_t *config, const run_t *runs, size_t count)
+{
+    printf("%zu objects of %zu bytes\n", config->objects, config->bytes);
+    printf("%-8s %12s %12s %14s %12s\n", "mode", "rss kB", "shared kB", "private kB", "copied kB");
+    for (size_t i = 0; i < count; i++)
+    {
+        printf("%-8s %12ld %12ld %14ld %12ld\n", runs[i].mode, runs[i].after.rss,
+               runs[i].after.shared, runs[i].after.private_dirty,
+               runs[i].after.private_dirty - runs[i].before.private_dirty);
+    }
+}
+
+static bool write_report(const config_t *config, const run_t *runs, size_t count)
+{
+    FILE *out = fopen(config->output, "w");
+    if (!out)
+    {
+        perror(config->output);
+        return false;
+    }
+    fprintf(out, "{\n  \"objects\": %zu,\n  \"bytes\": %zu,\n  \"runs\": [\n", config->objects,
+            config->bytes);
+    for (size_t i = 0; i < count; i++)
+    {
+        fprintf(out,
+                "    {\"mode\": \"%s\", \"rss_kb\": %ld, \"shared_kb\": %ld, "
+                "\"private_dirty_kb\": %ld, \"copied_kb\": %ld}%s\n",
+                runs[i].mode, runs[i].after.rss, runs[i].after.shared, runs[i].after.private_dirty,
+                runs[i].after.private_dirty - runs[i].before.private_dirty,
+                i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    config_t config;
+    if (!parse_options(argc, argv, &config))
+    {
+        return 2;
+    }
+
+    obj **objects = malloc(config.objects * sizeof(obj *));
+    if (!objects)
+    {
+        fprintf(stderr, "fork_rss: out of memory\n");
+        return 1;
+    }
+    /* The sweep in allocate would find nothing to free anyway */
+    set_cascade_limit(0);
+    for (size_t i = 0; i < config.objects; i++)
+    {
+        /* Written, so that the payload pages exist before the fork */
+        memset(allocate(config.bytes, NULL), 1, config.bytes);
+    }
+    set_cascade_limit(SIZE_MAX);
+    obj **next = objects;
+    refmem_for_each_object(set_rc_to_one, &next);
+
+    run_t runs[2] = {{.mode = "live"}, {.mode = "frozen"}};
+    bool ok = measure_child(objects, config.objects, &runs[0]);
+    refmem_freeze();
+    ok = ok && measure_child(objects, config.objects, &runs[1]);
+    if (!ok)
+    {
+        fprintf(stderr, "fork_rss: could not measure a child, is /proc/self/smaps_rollup there?\n");
+        return 1;
+    }
+
+    print_report(&config, runs, 2);
+    bool written = !config.output || write_report(&config, runs, 2);
+    shutdown();
+    free(objects);
+    return written ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+/**
+ * @file hash_table_inline.c
+ * @brief demo/hash_table.c with retain_inline and release_inline in place of
+ * retain and release, so that refmem_bench can time the same lookup loop
+ * with either. The public functions are renamed from ioopm_hash_table_ to
+ * inline_hash_table_ to keep them apart from demo/hash_table.o.
+ */
+
+#include "../src/refmem_inline.h"
+
+#define retain retain_inline
+#define release release_inline
+
+#define ioopm_hash_table_create inline_hash_table_create
+#define ioopm_hash_table_destroy inline_hash_table_destroy
+#define ioopm_hash_table_insert inline_hash_table_insert
+#define ioopm_hash_table_lookup inline_hash_table_lookup
+#define ioopm_hash_table_remove inline_hash_table_remove
+#define ioopm_hash_table_size inline_hash_table_size
+#define ioopm_hash_table_isempty inline_hash_table_isempty
+#define ioopm_hash_table_clear inline_hash_table_clear
+#define ioopm_hash_table_getkeys inline_hash_table_getkeys
+#define ioopm_hash_table_getvalues inline_hash_table_getvalues
+#define ioopm_hash_table_has_key inline_hash_table_has_key
+#define ioopm_hash_table_has_value inline_hash_table_has_value
+#define ioopm_hash_table_any inline_hash_table_any
+#define ioopm_hash_table_all inline_hash_table_all
+#define ioopm_hash_table_apply_all inline_hash_table_apply_all
+#define get_first_entry_in_bucket inline_get_first_entry_in_bucket
+
+#include "../demo/hash_table.c"
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdbool.h>
+#include "../demo/hash_table.h"
+
+/**
+ * @file hash_table_inline.h
+ * @brief The functions of demo/hash_table.c that refmem_bench uses, built
+ * with retain_inline and release_inline, see hash_table_inline.c.
+ */
+
+/// @brief ioopm_hash_table_create, with inlined reference counting
+ioopm_hash_table_t *inline_hash_table_create(ioopm_hash_function hash_function, ioopm_eq_func key_eq_function,
+                                             ioopm_eq_func value_eq_function);
+
+/// @brief ioopm_hash_table_destroy, with inlined reference counting
+void inline_hash_table_destroy(ioopm_hash_table_t *ht);
+
+/// @brief ioopm_hash_table_insert, with inlined reference counting
+void inline_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value);
+
+/// @brief ioopm_hash_table_lookup, with inlined reference counting
+bool inline_hash_table_lookup(ioopm_hash_table_t *ht, elem_t key, elem_t *ret);
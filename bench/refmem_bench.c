@@ -0,0 +1,624 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/refmem.h"
+#include "../src/refmem_collector.h"
+#include "../src/refmem_epoch.h"
+#include "../src/refmem_internal.h"
+#include "../src/refmem_remote.h"
+#include "../src/ref_vec.h"
+#include "../src/refmem_type.h"
+#include "../src/refmem_inline.h"
+#include "../demo/equality_functions.h"
+#include "../demo/hash_table.h"
+#include "bench.h"
+#include "hash_table_inline.h"
+
+/**
+ * @file refmem_bench.c
+ * @brief Microbenchmarks of the operations in refmem.h.
+ *
+ * Usage: refmem_bench [-f filter] [-o output.json] [-r repeats] [-t min run ms]
+ */
+
+static void set_rc_to_one(object_t *object_struct, void *extra)
+{
+    object_struct->rc = 1;
+}
+
+/// @brief Fill the heap with `count` objects of `bytes` bytes. The reference
+///        counts are set directly, since calling retain() on every object
+///        would make building a large heap quadratic.
+/// @param retained whether the objects get reference count 1 or stay garbage
+/// @return the newest object, which is found last by a lookup
+static obj *build_heap(size_t count, size_t bytes, bool retained)
+{
+    size_t limit = get_cascade_limit();
+    set_cascade_limit(0);
+    obj *newest = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        newest = allocate(bytes, NULL);
+    }
+    set_cascade_limit(limit);
+    if (retained)
+    {
+        refmem_for_each_object(set_rc_to_one, NULL);
+    }
+    return newest;
+}
+
+/// @brief allocate, retain and release an object of `bytes` bytes on an
+///        empty heap
+static uint64_t bench_allocate_release(size_t bytes, uint64_t iterations)
+{
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        obj *o = allocate(bytes, NULL);
+        retain(o);
+        release(o);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+/// @brief allocate_uninit, retain and release an object of `bytes` bytes on
+///        an empty heap
+static uint64_t bench_allocate_uninit(size_t bytes, uint64_t iterations)
+{
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        obj *o = allocate_uninit(bytes, NULL);
+        retain(o);
+        release(o);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+/// @brief retain and release the newest of `live` objects
+static uint64_t bench_retain_release(size_t live, uint64_t iterations)
+{
+    obj *newest = build_heap(live, 16, true);
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        retain(newest);
+        release(newest);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+/// @brief rc of the newest of `live` objects
+static uint64_t bench_rc(size_t live, uint64_t iterations)
+{
+    obj *newest = build_heap(live, 16, true);
+    volatile size_t sink = 0;
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        sink += rc(newest);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+// The number of objects on the heap in the cleanup benchmark
+#define CLEANUP_HEAP_SIZE 1000
+
+typedef struct garbage_context garbage_context_t;
+struct garbage_context
+{
+    size_t index;
+    size_t percent;
+};
+
+static void set_garbage_ratio(object_t *object_struct, void *extra)
+{
+    garbage_context_t *context = extra;
+    /* Spread the garbage evenly over the heap */
+    size_t before = context->index * context->percent / 100;
+    size_t after = (context->index + 1) * context->percent / 100;
+    object_struct->rc = after > before ? 0 : 1;
+    context->index++;
+}
+
+/// @brief cleanup() of a heap of CLEANUP_HEAP_SIZE objects of which
+///        `percent` percent are garbage
+static uint64_t bench_cleanup(size_t percent, uint64_t iterations)
+{
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        build_heap(CLEANUP_HEAP_SIZE, 16, false);
+        garbage_context_t context = {.percent = percent};
+        refmem_for_each_object(set_garbage_ratio, &context);
+
+        uint64_t start = bench_start();
+        cleanup();
+        elapsed += bench_stop(start);
+        shutdown();
+    }
+    return elapsed;
+}
+
+// The number of live objects in the default destructor benchmark
+#define SCAN_HEAP_SIZE 100
+
+/// @brief Free an object of `bytes` bytes with the default destructor, which
+///        looks for managed pointers in every word of it
+static uint64_t bench_default_destructor(size_t bytes, uint64_t iterations)
+{
+    build_heap(SCAN_HEAP_SIZE, 16, true);
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        obj *o = allocate(bytes, NULL);
+        retain(o);
+        uint64_t start = bench_start();
+        release(o);
+        elapsed += bench_stop(start);
+    }
+    shutdown();
+    return elapsed;
+}
+
+/// @brief shutdown() with `objects` live objects
+static uint64_t bench_shutdown(size_t objects, uint64_t iterations)
+{
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        build_heap(objects, 16, true);
+        uint64_t start = bench_start();
+        shutdown();
+        elapsed += bench_stop(start);
+    }
+    return elapsed;
+}
+
+// The number of objects in a chain in the release chain benchmark
+#define CHAIN_LENGTH 100
+
+typedef struct chain chain_t;
+struct chain
+{
+    chain_t *next;
+};
+
+typedef struct tree_node tree_node_t;
+struct tree_node
+{
+    tree_node_t *left;
+    tree_node_t *right;
+    double payload[30];
+};
+REFMEM_DEFINE_TYPE(tree_node_t, left, right)
+
+/// @brief Release a node with two children among 1000 live objects, freed by
+///        the default destructor or by the one REFMEM_DEFINE_TYPE generates
+/// @param typed 1 to allocate the nodes with tree_node_t_new_owned
+static uint64_t bench_typed_release(size_t typed, uint64_t iterations)
+{
+    build_heap(1000, 16, true);
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        tree_node_t *nodes[3];
+        for (size_t j = 0; j < 3; j++)
+        {
+            nodes[j] = typed ? tree_node_t_new_owned() : allocate_owned(sizeof(tree_node_t), NULL);
+        }
+        nodes[0]->left = nodes[1];
+        nodes[0]->right = nodes[2];
+        uint64_t start = bench_start();
+        release(nodes[0]);
+        elapsed += bench_stop(start);
+    }
+    shutdown();
+    return elapsed;
+}
+
+#define LOOKUP_ENTRIES 1000
+
+/// @brief Look up every key of a demo/hash_table.c table of 1000 entries,
+///        which retains and releases each entry it walks past
+/// @param inlined 1 to use the copy built with retain_inline and
+///        release_inline, see hash_table_inline.c
+static uint64_t bench_hash_lookup(size_t inlined, uint64_t iterations)
+{
+    ioopm_hash_table_t *(*create)(ioopm_hash_function, ioopm_eq_func, ioopm_eq_func) =
+        inlined ? inline_hash_table_create : ioopm_hash_table_create;
+    void (*insert)(ioopm_hash_table_t *, elem_t, elem_t) = inlined ? inline_hash_table_insert : ioopm_hash_table_insert;
+    bool (*lookup)(ioopm_hash_table_t *, elem_t, elem_t *) = inlined ? inline_hash_table_lookup : ioopm_hash_table_lookup;
+    void (*destroy)(ioopm_hash_table_t *) = inlined ? inline_hash_table_destroy : ioopm_hash_table_destroy;
+
+    ioopm_hash_table_t *ht = create(ioopm_simple_unsint_hash, ioopm_unsint_equal, ioopm_unsint_equal);
+    for (size_t key = 0; key < LOOKUP_ENTRIES; key++)
+    {
+        insert(ht, (elem_t){.uns_int = key}, (elem_t){.uns_int = key});
+    }
+    volatile size_t found = 0;
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        elem_t value;
+        if (lookup(ht, (elem_t){.uns_int = i % LOOKUP_ENTRIES}, &value))
+        {
+            found += value.uns_int;
+        }
+    }
+    uint64_t elapsed = bench_stop(start);
+    destroy(ht);
+    shutdown();
+    return elapsed;
+}
+
+#define GROWN_SIZE (1 << 20)
+
+/// @brief Grow a buffer by doubling from 16 bytes to GROWN_SIZE, by copying
+///        it into a new object every time or with reallocate
+/// @param in_place 1 to grow it with reallocate
+static uint64_t bench_grow_buffer(size_t in_place, uint64_t iterations)
+{
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        size_t size = 16;
+        char *buffer = allocate_ex(size, NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
+        while (size < GROWN_SIZE)
+        {
+            if (in_place)
+            {
+                buffer = reallocate(buffer, 2 * size);
+            }
+            else
+            {
+                char *grown = allocate_ex(2 * size, NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
+                memcpy(grown, buffer, size);
+                release(buffer);
+                buffer = grown;
+            }
+            size *= 2;
+        }
+        release(buffer);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+/// @brief Push `elements` ints onto a ref_vec
+static uint64_t bench_vec_push(size_t elements, uint64_t iterations)
+{
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        ref_vec_t *vec = ref_vec_create(sizeof(int));
+        for (size_t j = 0; j < elements; j++)
+        {
+            int elem = (int)j;
+            ref_vec_push(vec, &elem);
+        }
+        release(vec);
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+#define BATCH_SIZE 1000
+
+/// @brief Keeps the default destructor's scan out of the batch benchmark
+static void no_destructor(obj *object)
+{
+}
+
+/// @brief Release BATCH_SIZE objects in a shuffled order, as a hash table
+///        that is cleared would, one at a time or with release_many
+/// @param many 1 to release them with one call of release_many
+static uint64_t bench_release_batch(size_t many, uint64_t iterations)
+{
+    obj *objects[BATCH_SIZE];
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        for (size_t j = 0; j < BATCH_SIZE; j++)
+        {
+            objects[j] = allocate_owned(16 * (1 + j % 4), no_destructor);
+        }
+        /* The same shuffle every time */
+        uint64_t random = 88172645463325252ULL;
+        for (size_t j = BATCH_SIZE - 1; j > 0; j--)
+        {
+            random ^= random << 13;
+            random ^= random >> 7;
+            random ^= random << 17;
+            size_t k = random % (j + 1);
+            obj *swap = objects[j];
+            objects[j] = objects[k];
+            objects[k] = swap;
+        }
+        uint64_t start = bench_start();
+        if (many)
+        {
+            release_many(objects, BATCH_SIZE);
+        }
+        else
+        {
+            for (size_t j = 0; j < BATCH_SIZE; j++)
+            {
+                release(objects[j]);
+            }
+        }
+        elapsed += bench_stop(start);
+    }
+    shutdown();
+    return elapsed;
+}
+
+/// @brief release() of the head of a chain of CHAIN_LENGTH objects, which
+///        frees the whole chain, with or without the collector thread. The
+///        collector gets to empty its queue between releases, as it would
+///        on a core of its own.
+/// @param collector 1 to hand the chain to the collector thread
+static uint64_t bench_release_chain(size_t collector, uint64_t iterations)
+{
+    if (collector)
+    {
+        refmem_collector_start(SIZE_MAX);
+    }
+    uint64_t elapsed = 0;
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        chain_t *head = NULL;
+        for (size_t j = 0; j < CHAIN_LENGTH; j++)
+        {
+            chain_t *link = allocate(sizeof(chain_t), NULL);
+            link->next = head;
+            retain(link);
+            head = link;
+        }
+        uint64_t start = bench_start();
+        release(head);
+        elapsed += bench_stop(start);
+        while (refmem_collector_queued_bytes() > 0)
+        {
+            sched_yield();
+        }
+    }
+    refmem_collector_stop();
+    shutdown();
+    return elapsed;
+}
+
+/// @brief Walk a chain of CHAIN_LENGTH objects, either retaining and
+///        releasing every object on the way or inside an epoch
+/// @param epoch 1 to read inside an epoch
+static uint64_t bench_traverse(size_t epoch, uint64_t iterations)
+{
+    chain_t *head = NULL;
+    for (size_t j = 0; j < CHAIN_LENGTH; j++)
+    {
+        chain_t *link = allocate(sizeof(chain_t), NULL);
+        link->next = head;
+        retain(link);
+        head = link;
+    }
+    volatile size_t sink = 0;
+    uint64_t start = bench_start();
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        if (epoch)
+        {
+            refmem_epoch_enter();
+            for (chain_t *link = head; link; link = link->next)
+            {
+                sink++;
+            }
+            refmem_epoch_exit();
+        }
+        else
+        {
+            for (chain_t *link = head; link;)
+            {
+                retain(link);
+                sink++;
+                chain_t *next = link->next;
+                release(link);
+                link = next;
+            }
+        }
+    }
+    uint64_t elapsed = bench_stop(start);
+    shutdown();
+    return elapsed;
+}
+
+// The number of objects released per round in the remote release benchmark
+#define REMOTE_BATCH 1000
+
+// The most producer threads in the remote release benchmark
+#define MAX_PRODUCERS 16
+
+typedef struct producer producer_t;
+struct producer
+{
+    obj **objects;
+    size_t count;
+    pthread_t thread;
+};
+
+static void *release_remotely(void *extra)
+{
+    producer_t *producer = extra;
+    for (size_t i = 0; i < producer->count; i++)
+    {
+        refmem_release_remote(producer->objects[i]);
+    }
+    return NULL;
+}
+
+static void collect_object(object_t *object_struct, void *extra)
+{
+    obj ***next = extra;
+    *(*next)++ = object_struct->object;
+}
+
+/// @brief Release objects from `producers` threads while the calling thread
+///        drains the queue and frees them. With 0 producers the calling
+///        thread releases the objects itself.
+static uint64_t bench_remote_release(size_t producers, uint64_t iterations)
+{
+    obj *objects[REMOTE_BATCH];
+    producer_t workers[MAX_PRODUCERS];
+    uint64_t elapsed = 0;
+    for (uint64_t done = 0; done < iterations; done += REMOTE_BATCH)
+    {
+        size_t batch = iterations - done < REMOTE_BATCH ? iterations - done : REMOTE_BATCH;
+        build_heap(batch, 16, true);
+        obj **next = objects;
+        refmem_for_each_object(collect_object, &next);
+
+        uint64_t start = bench_start();
+        if (producers == 0)
+        {
+            for (size_t i = 0; i < batch; i++)
+            {
+                release(objects[i]);
+            }
+        }
+        else
+        {
+            for (size_t i = 0; i < producers; i++)
+            {
+                workers[i].objects = objects + batch * i / producers;
+                workers[i].count = batch * (i + 1) / producers - batch * i / producers;
+                pthread_create(&workers[i].thread, NULL, release_remotely, &workers[i]);
+            }
+            for (size_t released = 0; released < batch;)
+            {
+                size_t drained = refmem_drain_remote();
+                if (drained == 0)
+                {
+                    sched_yield();
+                }
+                released += drained;
+            }
+            for (size_t i = 0; i < producers; i++)
+            {
+                pthread_join(workers[i].thread, NULL);
+            }
+        }
+        elapsed += bench_stop(start);
+        shutdown();
+    }
+    return elapsed;
+}
+
+// The number of objects in the parallel shutdown benchmark
+#define SHUTDOWN_HEAP_SIZE 100000
+
+/// @brief shutdown() of SHUTDOWN_HEAP_SIZE objects on `threads` threads
+static uint64_t bench_shutdown_threads(size_t threads, uint64_t iterations)
+{
+    set_shutdown_threads(threads);
+    uint64_t elapsed = bench_shutdown(SHUTDOWN_HEAP_SIZE, iterations);
+    set_shutdown_threads(1);
+    return elapsed;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options_t options;
+    if (!bench_parse_options(argc, argv, &options))
+    {
+        return 2;
+    }
+    bench_begin("refmem", &options);
+
+    size_t sizes[] = {16, 256, 4096, 65536};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_run("allocate_release", "bytes", sizes[i], bench_allocate_release);
+    }
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        bench_run("allocate_uninit", "bytes", sizes[i], bench_allocate_uninit);
+    }
+
+    size_t live[] = {10, 100, 1000};
+    for (size_t i = 0; i < sizeof(live) / sizeof(live[0]); i++)
+    {
+        bench_run("retain_release", "live", live[i], bench_retain_release);
+    }
+    for (size_t i = 0; i < sizeof(live) / sizeof(live[0]); i++)
+    {
+        bench_run("rc", "live", live[i], bench_rc);
+    }
+
+    size_t percents[] = {0, 10, 50, 100};
+    for (size_t i = 0; i < sizeof(percents) / sizeof(percents[0]); i++)
+    {
+        bench_run("cleanup", "garbage_percent", percents[i], bench_cleanup);
+    }
+
+    size_t scanned[] = {64, 1024, 16384};
+    for (size_t i = 0; i < sizeof(scanned) / sizeof(scanned[0]); i++)
+    {
+        bench_run("default_destructor", "bytes", scanned[i], bench_default_destructor);
+    }
+
+    size_t objects[] = {100, 1000, 10000, 1000000};
+    for (size_t i = 0; i < sizeof(objects) / sizeof(objects[0]); i++)
+    {
+        bench_run("shutdown", "objects", objects[i], bench_shutdown);
+    }
+
+    bench_run("traverse", "epoch", 0, bench_traverse);
+    bench_run("traverse", "epoch", 1, bench_traverse);
+
+    bench_run("hash_lookup", "inline", 0, bench_hash_lookup);
+    bench_run("hash_lookup", "inline", 1, bench_hash_lookup);
+
+    bench_run("typed_release", "typed", 0, bench_typed_release);
+    bench_run("typed_release", "typed", 1, bench_typed_release);
+
+    bench_run("grow_buffer", "reallocate", 0, bench_grow_buffer);
+    bench_run("grow_buffer", "reallocate", 1, bench_grow_buffer);
+
+    size_t pushed[] = {1000, 100000};
+    for (size_t i = 0; i < sizeof(pushed) / sizeof(pushed[0]); i++)
+    {
+        bench_run("vec_push", "elements", pushed[i], bench_vec_push);
+    }
+
+    bench_run("release_batch", "many", 0, bench_release_batch);
+    bench_run("release_batch", "many", 1, bench_release_batch);
+
+    bench_run("release_chain", "collector", 0, bench_release_chain);
+    bench_run("release_chain", "collector", 1, bench_release_chain);
+
+    size_t producers[] = {0, 1, 2, 4};
+    for (size_t i = 0; i < sizeof(producers) / sizeof(producers[0]); i++)
+    {
+        bench_run("remote_release", "producers", producers[i], bench_remote_release);
+    }
+
+    size_t threads[] = {1, 2, 4, 8, 16};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+        bench_run("shutdown_threads", "threads", threads[i], bench_shutdown_threads);
+    }
+
+    return bench_end() ? 0 : 1;
+}
@@ -0,0 +1,668 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "../src/refmem.h"
+#include "../src/refmem_inline.h"
+#include "../src/refmem_internal.h"
+#include "bench.h"
+
+/**
+ * @file scaling.c
+ * @brief Checks how the cost of each operation in refmem.h grows with the
+ * number of live objects.
+ *
+ * Every operation is timed on heaps of 10^3 up to 10^max objects, and the
+ * growth exponent is fitted by least squares on a log-log scale. The
+ * benchmark fails if an exponent exceeds the declared complexity of its
+ * operation by more than the tolerance, so that accidental quadratic paths
+ * are caught as soon as they appear. Operations that take an object are
+ * timed on the newest object, which lookups find last.
+ *
+ * retain, release and rc are constant time where they read the object's
+ * struct from the header in front of the payload: in FAST builds, and for
+ * retain_inline and release_inline unless HOOKS or CHECKED make them call
+ * retain and release. Otherwise they look the object up among every object.
+ * retain_many, release_many and refmem_move look their objects up the same
+ * way. allocate and cleanup look for garbage among every object, and
+ * deallocate, reallocate and refmem_freeze walk the list of them, so those
+ * are linear in every build. cleanup is also timed with garbage that grows
+ * with the heap, which one sweep must still free in linear time.
+ *
+ * Each heap size is measured in a child process. A size is dropped for an
+ * operation when the previous size already took so long, setup included,
+ * that at the declared complexity it would exceed the time budget. A dropped
+ * size fails the run, since the exponent would be fitted to fewer sizes
+ * than were asked for.
+ *
+ * Usage: scaling [-m max exponent] [-o output.json]
+ */
+
+// Allowed excess of a fitted exponent over the declared one, which leaves
+// room for cache effects as the heap outgrows each level of cache
+#define TOLERANCE 0.5
+
+// An operation is timed until it has run this long, or run MAX_REPS times
+#define MIN_TIMING_NS 10000000
+#define MAX_REPS (1 << 20)
+
+// Sizes are dropped for an operation when timing it is expected to take
+// longer than this, untimed setup included
+#define BUDGET_NS 20000000000.0
+
+#define MIN_EXPONENT 3
+#define MAX_EXPONENT 7
+
+// The declared exponent of retain, release and rc
+#ifdef REFMEM_FAST
+#define LOOKUP 0
+#else
+#define LOOKUP 1
+#endif
+
+// The declared exponent of retain_inline and release_inline
+#if defined(REFMEM_HOOKS) || defined(REFMEM_CHECKED)
+#define INLINE_LOOKUP 1
+#else
+#define INLINE_LOOKUP 0
+#endif
+
+typedef uint64_t (*op_fun_t)(obj *newest, size_t reps);
+
+// The number of live objects the heap was built with
+static size_t heap_size = 0;
+
+typedef struct op op_t;
+struct op
+{
+    const char *name;
+    /// @brief The declared complexity as an exponent of the heap size
+    double declared;
+    op_fun_t fun;
+};
+
+static uint64_t op_allocate(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate(16, NULL);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_array(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_array(4, 4, NULL);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_owned(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_owned(16, NULL);
+        elapsed += bench_now_ns() - start;
+        release(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_uninit(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_uninit(16, NULL);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_aligned(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_aligned(16, 64, NULL);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_with_trailer(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_with_trailer(16, 16, 1, NULL);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_allocate_ex(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        obj *o = allocate_ex(16, NULL, REFMEM_UNINIT, 64, 16);
+        elapsed += bench_now_ns() - start;
+        deallocate(o);
+    }
+    return elapsed;
+}
+
+/// @brief reallocate() of an object of its own, which may move it
+static uint64_t op_reallocate(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        obj *o = allocate_owned(16, NULL);
+        uint64_t start = bench_now_ns();
+        o = reallocate(o, 64);
+        elapsed += bench_now_ns() - start;
+        release(o);
+    }
+    return elapsed;
+}
+
+static uint64_t op_retain(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        retain(newest);
+        elapsed += bench_now_ns() - start;
+        release(newest);
+    }
+    return elapsed;
+}
+
+static uint64_t op_release(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        retain(newest);
+        uint64_t start = bench_now_ns();
+        release(newest);
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+static uint64_t op_retain_inline(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        retain_inline(newest);
+        elapsed += bench_now_ns() - start;
+        release_inline(newest);
+    }
+    return elapsed;
+}
+
+static uint64_t op_release_inline(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        retain_inline(newest);
+        uint64_t start = bench_now_ns();
+        release_inline(newest);
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+// The number of objects retain_many and release_many are given
+#define BATCH 8
+
+static uint64_t op_retain_many(obj *newest, size_t reps)
+{
+    obj *objects[BATCH];
+    for (size_t i = 0; i < BATCH; i++)
+    {
+        objects[i] = newest;
+    }
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        uint64_t start = bench_now_ns();
+        retain_many(objects, BATCH);
+        elapsed += bench_now_ns() - start;
+        release_many(objects, BATCH);
+    }
+    return elapsed;
+}
+
+static uint64_t op_release_many(obj *newest, size_t reps)
+{
+    obj *objects[BATCH];
+    for (size_t i = 0; i < BATCH; i++)
+    {
+        objects[i] = newest;
+    }
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        retain_many(objects, BATCH);
+        uint64_t start = bench_now_ns();
+        release_many(objects, BATCH);
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+/// @brief refmem_move() onto a reference it replaces, which is released
+static uint64_t op_move(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        retain(newest);
+        retain(newest);
+        obj *dst = newest;
+        obj *src = newest;
+        uint64_t start = bench_now_ns();
+        refmem_move(&dst, &src);
+        elapsed += bench_now_ns() - start;
+        release(dst);
+    }
+    return elapsed;
+}
+
+static uint64_t op_rc(obj *newest, size_t reps)
+{
+    volatile size_t sink = 0;
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < reps; i++)
+    {
+        sink += rc(newest);
+    }
+    return bench_now_ns() - start;
+}
+
+static uint64_t op_deallocate(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        obj *o = allocate(16, NULL);
+        uint64_t start = bench_now_ns();
+        deallocate(o);
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+/// @brief cleanup() of a heap with a single garbage object
+static uint64_t op_cleanup(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        allocate(16, NULL);
+        uint64_t start = bench_now_ns();
+        cleanup();
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+/// @brief cleanup() of a heap with a tenth as many garbage objects as live
+///        ones, all freed in one sweep
+static uint64_t op_cleanup_garbage(obj *newest, size_t reps)
+{
+    uint64_t elapsed = 0;
+    for (size_t i = 0; i < reps; i++)
+    {
+        /* allocate leaves the garbage alone with a cascade limit of 0 */
+        set_cascade_limit(0);
+        for (size_t j = 0; j < heap_size / 10; j++)
+        {
+            allocate(16, NULL);
+        }
+        set_cascade_limit(SIZE_MAX);
+        uint64_t start = bench_now_ns();
+        cleanup();
+        elapsed += bench_now_ns() - start;
+    }
+    return elapsed;
+}
+
+static uint64_t op_cascade_limit(obj *newest, size_t reps)
+{
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < reps; i++)
+    {
+        set_cascade_limit(get_cascade_limit());
+    }
+    return bench_now_ns() - start;
+}
+
+static uint64_t op_shutdown_options(obj *newest, size_t reps)
+{
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < reps; i++)
+    {
+        set_shutdown_destructors(get_shutdown_destructors());
+        set_shutdown_threads(get_shutdown_threads());
+    }
+    return bench_now_ns() - start;
+}
+
+/// @brief refmem_freeze() of the whole heap. Frozen objects are immortal,
+///        so it runs after every operation that changes a reference count.
+static uint64_t op_freeze(obj *newest, size_t reps)
+{
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < reps; i++)
+    {
+        refmem_freeze();
+    }
+    return bench_now_ns() - start;
+}
+
+/// @brief shutdown() of the whole heap, so reps is always 1
+static uint64_t op_shutdown(obj *newest, size_t reps)
+{
+    uint64_t start = bench_now_ns();
+    shutdown();
+    return bench_now_ns() - start;
+}
+
+// refmem_freeze must come after the operations that change reference
+// counts, and shutdown last, as it frees the heap
+static const op_t ops[] = {
+    {"allocate", 1, op_allocate},
+    {"allocate_array", 1, op_allocate_array},
+    {"allocate_owned", 1, op_allocate_owned},
+    {"allocate_uninit", 1, op_allocate_uninit},
+    {"allocate_aligned", 1, op_allocate_aligned},
+    {"allocate_with_trailer", 1, op_allocate_with_trailer},
+    {"allocate_ex", 1, op_allocate_ex},
+    {"reallocate", 1, op_reallocate},
+    {"retain", LOOKUP, op_retain},
+    {"release", LOOKUP, op_release},
+    {"retain_inline", INLINE_LOOKUP, op_retain_inline},
+    {"release_inline", INLINE_LOOKUP, op_release_inline},
+    {"retain_many", LOOKUP, op_retain_many},
+    {"release_many", LOOKUP, op_release_many},
+    {"refmem_move", LOOKUP, op_move},
+    {"rc", LOOKUP, op_rc},
+    {"deallocate", 1, op_deallocate},
+    {"cleanup", 1, op_cleanup},
+    {"cleanup (n/10 garbage)", 1, op_cleanup_garbage},
+    {"set/get_cascade_limit", 0, op_cascade_limit},
+    {"set/get_shutdown_*", 0, op_shutdown_options},
+    {"refmem_freeze", 1, op_freeze},
+    {"shutdown (whole heap)", 1, op_shutdown},
+};
+#define OP_COUNT (sizeof(ops) / sizeof(ops[0]))
+
+static void set_rc_to_one(object_t *object_struct, void *extra)
+{
+    object_struct->rc = 1;
+}
+
+/// @brief Fill the heap with `count` retained objects. Reference counts are
+///        set directly, since retain() on every object would make building
+///        the heap quadratic.
+/// @return the newest object
+static obj *build_heap(size_t count)
+{
+    set_cascade_limit(0);
+    heap_size = count;
+    obj *newest = NULL;
+    for (size_t i = 0; i < count; i++)
+    {
+        newest = allocate(16, NULL);
+    }
+    set_cascade_limit(SIZE_MAX);
+    refmem_for_each_object(set_rc_to_one, NULL);
+    return newest;
+}
+
+// The number of timings per operation and size
+#define TIMINGS 3
+
+/// @brief The time per operation, the fastest of three timings that each
+///        run the operation often enough to be measurable. Operations with
+///        slow untimed setup stop repeating when the setup takes too long.
+/// @param wall_per_rep where the wall clock time per repetition, untimed
+///        setup included, is stored
+static double time_op(const op_t *op, obj *newest, bool once, double *wall_per_rep)
+{
+    double best = INFINITY;
+    uint64_t first = bench_now_ns();
+    size_t total_reps = 0;
+    for (int timing = 0; timing < (once ? 1 : TIMINGS); timing++)
+    {
+        size_t reps = 1;
+        uint64_t start = bench_now_ns();
+        uint64_t elapsed = op->fun(newest, reps);
+        while (!once && elapsed < MIN_TIMING_NS && reps < MAX_REPS &&
+               bench_now_ns() - start < 10 * MIN_TIMING_NS)
+        {
+            reps *= 2;
+            start = bench_now_ns();
+            elapsed = op->fun(newest, reps);
+        }
+        double per_op = (double)elapsed / reps;
+        best = per_op < best ? per_op : best;
+        total_reps += reps;
+    }
+    *wall_per_rep = (double)(bench_now_ns() - first) / total_reps;
+    return best;
+}
+
+/// @brief Measure every operation that is not dropped on a heap of `size`
+///        objects, in a child process so that the heap does not have to be
+///        freed if shutdown is dropped
+/// @param times where the time per operation is stored, NAN when dropped,
+///        followed by the wall clock time per repetition of each operation
+/// @return false if the child failed
+static bool measure_size(size_t size, const bool *drop, double *times)
+{
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        return false;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        obj *newest = build_heap(size);
+        double results[2 * OP_COUNT];
+        for (size_t i = 0; i < OP_COUNT; i++)
+        {
+            results[OP_COUNT + i] = NAN;
+            results[i] = drop[i] ? NAN : time_op(&ops[i], newest, ops[i].fun == op_shutdown, &results[OP_COUNT + i]);
+        }
+        ssize_t written = write(fds[1], results, sizeof(results));
+        _exit(written == sizeof(results) ? 0 : 1);
+    }
+    close(fds[1]);
+    ssize_t got = pid > 0 ? read(fds[0], times, 2 * OP_COUNT * sizeof(double)) : -1;
+    close(fds[0]);
+    int status = 0;
+    if (pid > 0)
+    {
+        waitpid(pid, &status, 0);
+    }
+    return got == (ssize_t)(2 * OP_COUNT * sizeof(double)) && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/// @brief Least squares slope of log(time) against log(size)
+static double fit_exponent(const double *sizes, const double *times, size_t count)
+{
+    double sx = 0, sy = 0, sxx = 0, sxy = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (isnan(times[i]))
+        {
+            continue;
+        }
+        double x = log10(sizes[i]);
+        double y = log10(times[i] > 1 ? times[i] : 1);
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        n++;
+    }
+    if (n < 2)
+    {
+        return NAN;
+    }
+    return (n * sxy - sx * sy) / (n * sxx - sx * sx);
+}
+
+int main(int argc, char *argv[])
+{
+    int max_exponent = MAX_EXPONENT;
+    const char *output = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+        {
+            max_exponent = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-m max exponent] [-o output.json]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (max_exponent <= MIN_EXPONENT)
+    {
+        fprintf(stderr, "%s: the max exponent must be larger than %d\n", argv[0], MIN_EXPONENT);
+        return 2;
+    }
+
+    size_t size_count = max_exponent - MIN_EXPONENT + 1;
+    double sizes[MAX_EXPONENT * 2];
+    double times[OP_COUNT][MAX_EXPONENT * 2];
+    bool drop[OP_COUNT] = {false};
+    if (size_count > sizeof(sizes) / sizeof(sizes[0]))
+    {
+        fprintf(stderr, "%s: the max exponent is too large\n", argv[0]);
+        return 2;
+    }
+
+    printf("%-24s", "ns/op at heap size");
+    for (size_t s = 0; s < size_count; s++)
+    {
+        sizes[s] = pow(10, MIN_EXPONENT + s);
+        printf(" %12.0e", sizes[s]);
+    }
+    printf(" %9s %9s\n", "exponent", "declared");
+
+    bool failed = false;
+    for (size_t s = 0; s < size_count; s++)
+    {
+        double result[2 * OP_COUNT];
+        if (!measure_size((size_t)sizes[s], drop, result))
+        {
+            fprintf(stderr, "measuring a heap of %.0f objects failed\n", sizes[s]);
+            failed = true;
+            size_count = s;
+            break;
+        }
+        for (size_t i = 0; i < OP_COUNT; i++)
+        {
+            times[i][s] = result[i];
+            /* Drop the next size if it would take too long at the declared
+               complexity, including the tolerance */
+            double factor = pow(10, ops[i].declared + TOLERANCE);
+            drop[i] = drop[i] || TIMINGS * result[OP_COUNT + i] * factor > BUDGET_NS;
+        }
+    }
+
+    FILE *out = output ? fopen(output, "w") : NULL;
+    if (out)
+    {
+        fprintf(out, "{\n  \"suite\": \"scaling\",\n  \"tolerance\": %.2f,\n  \"operations\": [", TOLERANCE);
+    }
+    for (size_t i = 0; i < OP_COUNT; i++)
+    {
+        double exponent = fit_exponent(sizes, times[i], size_count);
+        bool too_slow = exponent > ops[i].declared + TOLERANCE;
+        bool dropped = false;
+
+        printf("%-24s", ops[i].name);
+        for (size_t s = 0; s < size_count; s++)
+        {
+            if (isnan(times[i][s]))
+            {
+                printf(" %12s", "dropped");
+                dropped = true;
+            }
+            else
+            {
+                printf(" %12.0f", times[i][s]);
+            }
+        }
+        printf(" %9.2f %9s%s\n", exponent, ops[i].declared ? (ops[i].declared == 1 ? "O(n)" : "O(n^2)") : "O(1)",
+               too_slow || dropped ? "  FAIL" : "");
+        failed |= too_slow || dropped;
+
+        if (out)
+        {
+            fprintf(out, "%s\n    {\"name\": \"%s\", \"declared\": %.1f, \"exponent\": %.3f, \"ns_per_op\": [",
+                    i ? "," : "", ops[i].name, ops[i].declared, isnan(exponent) ? -1.0 : exponent);
+            for (size_t s = 0; s < size_count; s++)
+            {
+                fprintf(out, "%s[%.0f, %.1f]", s ? ", " : "", sizes[s], isnan(times[i][s]) ? -1.0 : times[i][s]);
+            }
+            fprintf(out, "]}");
+        }
+    }
+    if (out)
+    {
+        fprintf(out, "\n  ]\n}\n");
+        fclose(out);
+    }
+    else if (output)
+    {
+        perror(output);
+        failed = true;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,677 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "../demo/store_logic.h"
+#include "../src/refmem.h"
+#include "../src/refmem_internal.h"
+#include "bench.h"
+
+/**
+ * @file store_workload.c
+ * @brief A macro-benchmark that drives the store in demo/store_logic.h with
+ * a synthetic workload, without the UI.
+ *
+ * The store is filled with merch, stocked shelves and open carts, then a
+ * random sequence of operations drawn from a configurable mix is run. Every
+ * checkout opens a new cart, so the number of open carts stays the same.
+ * The generator keeps a model of the store so that it only makes calls the
+ * store allows, e.g. it never names merch that has been removed.
+ *
+ * The throughput, the latency percentiles of each operation, the peak RSS
+ * and the peak number of live refmem objects are reported.
+ *
+ * Usage: store_workload [-m merch] [-s shelves] [-c carts] [-n operations]
+ *                       [-x mix] [-S seed] [-o output.json]
+ *
+ * The defaults are 1000 merch, 100 shelves, 100 carts and 2000 operations.
+ * The mix is a comma separated list of operation=weight, see DEFAULT_MIX.
+ */
+
+#define DEFAULT_MIX "add=5,edit=5,remove=5,replenish=15,cart_add=35,cart_remove=10,checkout=25"
+
+// Picking a valid target for an operation gives up after this many tries
+#define MAX_TRIES 8
+
+// No shelf, or no position in the live arrays
+#define NONE SIZE_MAX
+
+typedef enum op
+{
+    OP_ADD,
+    OP_EDIT,
+    OP_REMOVE,
+    OP_REPLENISH,
+    OP_CART_ADD,
+    OP_CART_REMOVE,
+    OP_CHECKOUT,
+    /// @brief Opening a cart, which follows every checkout, not in the mix
+    OP_NEW_CART,
+    OP_COUNT
+} op_t;
+
+static const char *op_names[OP_COUNT] = {"add", "edit", "remove", "replenish",
+                                         "cart_add", "cart_remove", "checkout", "new_cart"};
+
+typedef struct config config_t;
+struct config
+{
+    size_t merch;
+    size_t shelves;
+    size_t carts;
+    size_t operations;
+    unsigned weights[OP_COUNT];
+    uint64_t seed;
+    const char *output;
+};
+
+/// @brief What the generator knows about a merch
+typedef struct model_merch model_merch_t;
+struct model_merch
+{
+    char name[32];
+    /// @brief The number of the merch's only shelf, NONE if it has none
+    size_t shelf;
+    size_t stock;
+    size_t reserved;
+    /// @brief The position in the live array, NONE once removed
+    size_t live_index;
+};
+
+typedef struct model_ware model_ware_t;
+struct model_ware
+{
+    size_t merch;
+    size_t amount;
+};
+
+typedef struct model_cart model_cart_t;
+struct model_cart
+{
+    size_t id;
+    model_ware_t *wares;
+    size_t ware_count;
+    size_t ware_capacity;
+};
+
+typedef struct latencies latencies_t;
+struct latencies
+{
+    uint64_t *ns;
+    size_t count;
+    size_t capacity;
+    size_t succeeded;
+};
+
+typedef struct workload workload_t;
+struct workload
+{
+    ioopm_store_t *store;
+    /// @brief Every merch ever added, indexed by its number
+    model_merch_t *merch;
+    size_t merch_count;
+    size_t merch_capacity;
+    /// @brief The numbers of the merch still in the store
+    size_t *live;
+    size_t live_count;
+    size_t live_capacity;
+    model_cart_t *carts;
+    size_t cart_count;
+    size_t next_shelf;
+    size_t edits;
+    uint64_t random_state;
+    latencies_t latencies[OP_COUNT];
+    size_t peak_objects;
+};
+
+/// @brief xorshift64*, so that runs with the same seed are identical
+static uint64_t next_random(workload_t *w)
+{
+    w->random_state ^= w->random_state >> 12;
+    w->random_state ^= w->random_state << 25;
+    w->random_state ^= w->random_state >> 27;
+    return w->random_state * 2685821657736338717ull;
+}
+
+/// @return a random number in [0, bound), bound must be positive
+static size_t random_below(workload_t *w, size_t bound)
+{
+    return next_random(w) % bound;
+}
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t element_size)
+{
+    if (needed <= *capacity)
+    {
+        return array;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 16;
+    new_capacity = new_capacity < needed ? needed : new_capacity;
+    void *grown = realloc(array, new_capacity * element_size);
+    if (!grown)
+    {
+        fprintf(stderr, "store_workload: out of memory\n");
+        exit(2);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+/// @brief Record how long an operation took, and note the heap size after it
+static void note_latency(workload_t *w, op_t op, uint64_t start, bool succeeded)
+{
+    uint64_t elapsed = bench_now_ns() - start;
+    latencies_t *l = &w->latencies[op];
+    l->ns = grow(l->ns, &l->capacity, l->count + 1, sizeof(uint64_t));
+    l->ns[l->count++] = elapsed;
+    l->succeeded += succeeded;
+
+    size_t objects = refmem_object_count();
+    w->peak_objects = objects > w->peak_objects ? objects : w->peak_objects;
+}
+
+static void shelf_name(size_t shelf, char *buf, size_t buf_size)
+{
+    snprintf(buf, buf_size, "S%zu", shelf);
+}
+
+static size_t random_live_merch(workload_t *w)
+{
+    return w->live_count ? w->live[random_below(w, w->live_count)] : NONE;
+}
+
+static model_cart_t *random_cart(workload_t *w)
+{
+    return w->cart_count ? &w->carts[random_below(w, w->cart_count)] : NULL;
+}
+
+static model_ware_t *find_ware(model_cart_t *cart, size_t merch)
+{
+    for (size_t i = 0; i < cart->ware_count; i++)
+    {
+        if (cart->wares[i].merch == merch)
+        {
+            return &cart->wares[i];
+        }
+    }
+    return NULL;
+}
+
+static void op_add(workload_t *w)
+{
+    size_t number = w->merch_count++;
+    w->merch = grow(w->merch, &w->merch_capacity, w->merch_count, sizeof(model_merch_t));
+    model_merch_t *m = &w->merch[number];
+    *m = (model_merch_t){.shelf = NONE, .live_index = w->live_count};
+    snprintf(m->name, sizeof(m->name), "merch%zu", number);
+    w->live = grow(w->live, &w->live_capacity, w->live_count + 1, sizeof(size_t));
+    w->live[w->live_count++] = number;
+
+    char description[64];
+    snprintf(description, sizeof(description), "Description of merch %zu", number);
+    int cost = 1 + random_below(w, 1000);
+
+    uint64_t start = bench_now_ns();
+    ioopm_add_merch_to_store(w->store, m->name, description, cost);
+    note_latency(w, OP_ADD, start, true);
+}
+
+static void op_edit(workload_t *w)
+{
+    size_t number = random_live_merch(w);
+    if (number == NONE)
+    {
+        return;
+    }
+    model_merch_t *m = &w->merch[number];
+    char new_name[32];
+    char description[64];
+    snprintf(new_name, sizeof(new_name), "merch%zu.%zu", number, ++w->edits);
+    snprintf(description, sizeof(description), "Edited description of merch %zu", number);
+    int cost = 1 + random_below(w, 1000);
+
+    uint64_t start = bench_now_ns();
+    ioopm_merch_edit(w->store, m->name, new_name, description, cost);
+    note_latency(w, OP_EDIT, start, true);
+    memcpy(m->name, new_name, sizeof(new_name));
+}
+
+static void op_remove(workload_t *w)
+{
+    size_t number = random_live_merch(w);
+    if (number == NONE)
+    {
+        return;
+    }
+    model_merch_t *m = &w->merch[number];
+
+    uint64_t start = bench_now_ns();
+    bool removed = ioopm_merch_remove(w->store, m->name);
+    note_latency(w, OP_REMOVE, start, removed);
+
+    if (removed)
+    {
+        /* The store keeps the shelf, so its name is never used again */
+        size_t moved = w->live[--w->live_count];
+        w->live[m->live_index] = moved;
+        w->merch[moved].live_index = m->live_index;
+        m->live_index = NONE;
+    }
+}
+
+static void op_replenish(workload_t *w, size_t number)
+{
+    model_merch_t *m = &w->merch[number];
+    size_t shelf = m->shelf == NONE ? w->next_shelf++ : m->shelf;
+    char name[32];
+    shelf_name(shelf, name, sizeof(name));
+    int amount = 1 + random_below(w, 100);
+
+    uint64_t start = bench_now_ns();
+    bool replenished = ioopm_replenish_item(w->store, m->name, name, amount);
+    note_latency(w, OP_REPLENISH, start, replenished);
+
+    if (replenished)
+    {
+        m->shelf = shelf;
+        m->stock += amount;
+    }
+}
+
+static void op_cart_add(workload_t *w)
+{
+    model_cart_t *cart = random_cart(w);
+    size_t number = random_live_merch(w);
+    if (!cart || number == NONE)
+    {
+        return;
+    }
+    /* Prefer merch that is in stock and not yet in the cart, so that most
+       calls succeed */
+    for (int tries = 1; tries < MAX_TRIES; tries++)
+    {
+        model_merch_t *m = &w->merch[number];
+        if (m->stock > m->reserved && !find_ware(cart, number))
+        {
+            break;
+        }
+        number = random_live_merch(w);
+    }
+    model_merch_t *m = &w->merch[number];
+    size_t available = m->stock > m->reserved ? m->stock - m->reserved : 1;
+    size_t amount = 1 + random_below(w, available < 5 ? available : 5);
+
+    uint64_t start = bench_now_ns();
+    bool added = ioopm_add_to_cart(w->store, cart->id, m->name, amount);
+    note_latency(w, OP_CART_ADD, start, added);
+
+    if (added)
+    {
+        cart->wares = grow(cart->wares, &cart->ware_capacity, cart->ware_count + 1, sizeof(model_ware_t));
+        cart->wares[cart->ware_count++] = (model_ware_t){.merch = number, .amount = amount};
+        m->reserved += amount;
+    }
+}
+
+static void op_cart_remove(workload_t *w)
+{
+    model_cart_t *cart = random_cart(w);
+    for (int tries = 1; cart && cart->ware_count == 0 && tries < MAX_TRIES; tries++)
+    {
+        cart = random_cart(w);
+    }
+    if (!cart || cart->ware_count == 0)
+    {
+        return;
+    }
+    size_t index = random_below(w, cart->ware_count);
+    model_ware_t *ware = &cart->wares[index];
+    model_merch_t *m = &w->merch[ware->merch];
+    size_t amount = 1 + random_below(w, ware->amount);
+
+    uint64_t start = bench_now_ns();
+    bool removed = ioopm_remove_item_from_cart(w->store, cart->id, m->name, amount);
+    note_latency(w, OP_CART_REMOVE, start, removed);
+
+    if (removed)
+    {
+        m->reserved -= amount;
+        ware->amount -= amount;
+        if (ware->amount == 0)
+        {
+            *ware = cart->wares[--cart->ware_count];
+        }
+    }
+}
+
+static void open_cart(workload_t *w, model_cart_t *cart)
+{
+    uint64_t start = bench_now_ns();
+    size_t id = ioopm_add_cart_to_store(w->store);
+    note_latency(w, OP_NEW_CART, start, true);
+    cart->id = id;
+    cart->ware_count = 0;
+}
+
+static void op_checkout(workload_t *w)
+{
+    model_cart_t *cart = random_cart(w);
+    if (!cart)
+    {
+        return;
+    }
+    int cost;
+
+    uint64_t start = bench_now_ns();
+    bool checked_out = ioopm_checkout_cart(w->store, cart->id, &cost);
+    note_latency(w, OP_CHECKOUT, start, checked_out);
+
+    for (size_t i = 0; checked_out && i < cart->ware_count; i++)
+    {
+        model_merch_t *m = &w->merch[cart->wares[i].merch];
+        m->stock -= cart->wares[i].amount;
+        m->reserved -= cart->wares[i].amount;
+        /* The store removes a shelf once it is empty */
+        m->shelf = m->stock == 0 ? NONE : m->shelf;
+    }
+    open_cart(w, cart);
+}
+
+static void run_operation(workload_t *w, op_t op)
+{
+    switch (op)
+    {
+    case OP_ADD:
+        op_add(w);
+        break;
+    case OP_EDIT:
+        op_edit(w);
+        break;
+    case OP_REMOVE:
+        op_remove(w);
+        break;
+    case OP_REPLENISH:
+    {
+        size_t number = random_live_merch(w);
+        if (number != NONE)
+        {
+            op_replenish(w, number);
+        }
+        break;
+    }
+    case OP_CART_ADD:
+        op_cart_add(w);
+        break;
+    case OP_CART_REMOVE:
+        op_cart_remove(w);
+        break;
+    case OP_CHECKOUT:
+        op_checkout(w);
+        break;
+    default:
+        break;
+    }
+}
+
+static op_t pick_operation(workload_t *w, const config_t *config)
+{
+    unsigned total = 0;
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        total += config->weights[op];
+    }
+    size_t pick = random_below(w, total);
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        if (pick < config->weights[op])
+        {
+            return op;
+        }
+        pick -= config->weights[op];
+    }
+    return OP_ADD;
+}
+
+/// @brief Parse a mix such as DEFAULT_MIX into weights
+/// @return false if an operation is unknown or no weight is positive
+static bool parse_mix(const char *mix, unsigned *weights)
+{
+    memset(weights, 0, OP_COUNT * sizeof(unsigned));
+    unsigned total = 0;
+    while (*mix)
+    {
+        size_t length = strcspn(mix, "=");
+        op_t op = 0;
+        while (op < OP_NEW_CART && (strlen(op_names[op]) != length || strncmp(op_names[op], mix, length) != 0))
+        {
+            op++;
+        }
+        if (op == OP_NEW_CART || mix[length] != '=')
+        {
+            return false;
+        }
+        char *end;
+        weights[op] = strtoul(mix + length + 1, &end, 10);
+        total += weights[op];
+        if (*end != ',' && *end != '\0')
+        {
+            return false;
+        }
+        mix = *end ? end + 1 : end;
+    }
+    return total > 0;
+}
+
+static bool parse_options(int argc, char *argv[], config_t *config)
+{
+    *config = (config_t){.merch = 1000, .shelves = 100, .carts = 100, .operations = 2000, .seed = 1};
+    parse_mix(DEFAULT_MIX, config->weights);
+    for (int i = 1; i < argc; i++)
+    {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "-m") == 0 && has_value)
+        {
+            config->merch = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-s") == 0 && has_value)
+        {
+            config->shelves = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-c") == 0 && has_value)
+        {
+            config->carts = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-n") == 0 && has_value)
+        {
+            config->operations = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-x") == 0 && has_value && parse_mix(argv[i + 1], config->weights))
+        {
+            i++;
+        }
+        else if (strcmp(argv[i], "-S") == 0 && has_value)
+        {
+            config->seed = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-o") == 0 && has_value)
+        {
+            config->output = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [-m merch] [-s shelves] [-c carts] [-n operations] [-x mix] [-S seed] [-o output.json]\n"
+                    "mix defaults to %s\n",
+                    argv[0], DEFAULT_MIX);
+            return false;
+        }
+    }
+    return true;
+}
+
+/// @brief Fill the store with merch, stock the first of them on shelves and
+///        open the carts
+static void populate(workload_t *w, const config_t *config)
+{
+    for (size_t i = 0; i < config->merch; i++)
+    {
+        op_add(w);
+    }
+    for (size_t i = 0; i < config->shelves && i < w->live_count; i++)
+    {
+        op_replenish(w, w->live[i]);
+    }
+    w->carts = calloc(config->carts, sizeof(model_cart_t));
+    w->cart_count = config->carts;
+    for (size_t i = 0; i < w->cart_count; i++)
+    {
+        open_cart(w, &w->carts[i]);
+    }
+
+    /* Only the workload itself is reported */
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        w->latencies[op].count = 0;
+        w->latencies[op].succeeded = 0;
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/// @brief The nearest-rank percentile of sorted latencies
+static uint64_t percentile(const latencies_t *l, double p)
+{
+    size_t rank = (size_t)(p / 100 * l->count + 0.5);
+    rank = rank < 1 ? 1 : rank > l->count ? l->count : rank;
+    return l->ns[rank - 1];
+}
+
+static double mean(const latencies_t *l)
+{
+    double sum = 0;
+    for (size_t i = 0; i < l->count; i++)
+    {
+        sum += l->ns[i];
+    }
+    return l->count ? sum / l->count : 0;
+}
+
+static const double percentiles[] = {50, 90, 99, 99.9};
+#define PERCENTILE_COUNT (sizeof(percentiles) / sizeof(percentiles[0]))
+
+static void print_report(workload_t *w, double seconds, size_t operations, long peak_rss_kb)
+{
+    printf("%-12s %9s %9s %12s %12s %12s %12s %12s %12s\n", "operation", "count", "succeeded",
+           "mean us", "p50 us", "p90 us", "p99 us", "p99.9 us", "max us");
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        latencies_t *l = &w->latencies[op];
+        if (l->count == 0)
+        {
+            continue;
+        }
+        printf("%-12s %9zu %9zu %12.1f", op_names[op], l->count, l->succeeded, mean(l) / 1000);
+        for (size_t i = 0; i < PERCENTILE_COUNT; i++)
+        {
+            printf(" %12.1f", percentile(l, percentiles[i]) / 1000.0);
+        }
+        printf(" %12.1f\n", l->ns[l->count - 1] / 1000.0);
+    }
+    printf("%zu operations in %.2f s, %.0f ops/s, peak RSS %ld KB, peak %zu live objects\n",
+           operations, seconds, seconds > 0 ? operations / seconds : 0.0, peak_rss_kb, w->peak_objects);
+}
+
+static bool write_report(workload_t *w, const config_t *config, double seconds, size_t operations,
+                         long peak_rss_kb)
+{
+    FILE *out = fopen(config->output, "w");
+    if (!out)
+    {
+        perror(config->output);
+        return false;
+    }
+    fprintf(out, "{\n  \"suite\": \"store_workload\",\n  \"merch\": %zu,\n  \"shelves\": %zu,\n  \"carts\": %zu,\n"
+                 "  \"seed\": %llu,\n  \"operations\": %zu,\n  \"seconds\": %.6f,\n  \"ops_per_sec\": %.1f,\n"
+                 "  \"peak_rss_kb\": %ld,\n  \"peak_objects\": %zu,\n  \"latencies\": [",
+            config->merch, config->shelves, config->carts, (unsigned long long)config->seed, operations,
+            seconds, seconds > 0 ? operations / seconds : 0.0, peak_rss_kb, w->peak_objects);
+    bool first = true;
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        latencies_t *l = &w->latencies[op];
+        if (l->count == 0)
+        {
+            continue;
+        }
+        fprintf(out, "%s\n    {\"name\": \"%s\", \"count\": %zu, \"succeeded\": %zu, \"mean_ns\": %.1f, "
+                     "\"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu}",
+                first ? "" : ",", op_names[op], l->count, l->succeeded, mean(l),
+                (unsigned long long)percentile(l, 50), (unsigned long long)percentile(l, 90),
+                (unsigned long long)percentile(l, 99), (unsigned long long)percentile(l, 99.9),
+                (unsigned long long)l->ns[l->count - 1]);
+        first = false;
+    }
+    fprintf(out, "\n  ]\n}\n");
+    return fclose(out) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+    config_t config;
+    if (!parse_options(argc, argv, &config))
+    {
+        return 2;
+    }
+
+    workload_t w = {.store = ioopm_store_create(), .random_state = config.seed ? config.seed : 1};
+    uint64_t setup_start = bench_now_ns();
+    populate(&w, &config);
+    printf("populated %zu merch, %zu shelves and %zu carts in %.2f s\n", w.live_count, w.next_shelf,
+           w.cart_count, (bench_now_ns() - setup_start) / 1e9);
+
+    uint64_t start = bench_now_ns();
+    for (size_t i = 0; i < config.operations; i++)
+    {
+        run_operation(&w, pick_operation(&w, &config));
+    }
+    double seconds = (bench_now_ns() - start) / 1e9;
+
+    size_t operations = 0;
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        qsort(w.latencies[op].ns, w.latencies[op].count, sizeof(uint64_t), compare_u64);
+        operations += w.latencies[op].count;
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    print_report(&w, seconds, operations, usage.ru_maxrss);
+    bool written = !config.output || write_report(&w, &config, seconds, operations, usage.ru_maxrss);
+
+    uint64_t teardown_start = bench_now_ns();
+    ioopm_store_destroy(w.store);
+    shutdown();
+    printf("destroyed the store in %.2f s\n", (bench_now_ns() - teardown_start) / 1e9);
+
+    for (op_t op = 0; op < OP_COUNT; op++)
+    {
+        free(w.latencies[op].ns);
+    }
+    for (size_t i = 0; i < w.cart_count; i++)
+    {
+        free(w.carts[i].wares);
+    }
+    free(w.carts);
+    free(w.merch);
+    free(w.live);
+    return written ? 0 : 1;
+}
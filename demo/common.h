@@ -2,6 +2,8 @@
 #include <stdbool.h>
 #include <stddef.h>
 
+#include "../src/refmem.h"
+
 typedef struct list ioopm_list_t;
 typedef struct node ioopm_node_t;
 typedef union elem elem_t;
@@ -10,6 +12,18 @@ typedef bool (*ioopm_list_predicate)(size_t index, elem_t value, void *extra);
 typedef void (*ioopm_list_apply_func)(size_t index, elem_t *value, void *extra);
 typedef bool (*ioopm_eq_func)(elem_t a, elem_t b);
 
+/**
+ * @brief The destructor of the demo's data structures.
+ *
+ * Every structure has a destroy function that releases what the structure
+ * owns, e.g. a list releases its nodes and a merch its strings. The default
+ * destructor would release every pointer a second time, including values
+ * the structure merely refers to, so it is not used.
+ */
+static inline void ioopm_no_destructor(obj *object)
+{
+}
+
 // Unions
 
 union elem
@@ -134,8 +134,7 @@ entry_t *get_first_entry_in_bucket(ioopm_hash_table_t *ht, size_t bucket);
 ioopm_hash_table_t *ioopm_hash_table_create(ioopm_hash_function hash_function, ioopm_eq_func key_eq_function, ioopm_eq_func value_eq_function)
 {
     // Allocate memory for ioopm_hash_table_t (Num_buckets entries)
-    ioopm_hash_table_t *ht = allocate(sizeof(ioopm_hash_table_t), NULL);
-    retain(ht);
+    ioopm_hash_table_t *ht = allocate_owned(sizeof(ioopm_hash_table_t), ioopm_no_destructor);
     ht->key_eq_fun = key_eq_function;
     ht->value_eq_fun = value_eq_function;
     ht->size = 0;
@@ -159,7 +158,6 @@ void ioopm_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value)
 
     // Find previous entry, that will point to NULL if last in buckets
     entry_t *prev_entry = find_prev_entry_for_key(ht, key);
-    retain(prev_entry);
     entry_t *current_entry = prev_entry->next;
     retain(current_entry);
 
@@ -174,27 +172,23 @@ void ioopm_hash_table_insert(ioopm_hash_table_t *ht, elem_t key, elem_t value)
         prev_entry->next = entry_create(ht, key, value, current_entry);
     }
     release(current_entry);
-    release(prev_entry);
 }
 
 bool ioopm_hash_table_lookup(ioopm_hash_table_t *ht, elem_t key, elem_t *ret)
 {
 
     entry_t *prev_entry = find_prev_entry_for_key(ht, key);
-    retain(prev_entry);
     entry_t *current_entry = prev_entry->next;
     retain(current_entry);
 
     if (current_key_is_equal(ht, current_entry, key))
     {
         *ret = get_value(current_entry);
-        release(prev_entry);
         release(current_entry);
         return true;
     }
     else
     {
-        release(prev_entry);
         release(current_entry);
         return false;
     }
@@ -220,7 +214,6 @@ bool ioopm_hash_table_remove(ioopm_hash_table_t *ht, elem_t key, elem_t *ret)
     }
     else
     {
-        release(prev_entry);
         release(current_entry);
         return false;
     }
@@ -238,6 +231,10 @@ bool ioopm_hash_table_isempty(ioopm_hash_table_t *ht)
 
 void ioopm_hash_table_clear(ioopm_hash_table_t *ht)
 {
+    // Gather every entry, so that they are all released in one call
+    entry_t **entries = allocate_array_owned(ht->size, sizeof(entry_t *), ioopm_no_destructor);
+    size_t count = 0;
+
     for (size_t bucket = 0; bucket < Num_buckets; bucket += 1)
     {
         entry_t *current_bucket = &ht->buckets[bucket];
@@ -245,21 +242,28 @@ void ioopm_hash_table_clear(ioopm_hash_table_t *ht)
 
         while (current_entry != NULL)
         {
-            retain(current_entry);
+            if (entries)
+            {
+                entries[count++] = current_entry;
+                current_entry = current_entry->next;
+                continue;
+            }
             // Store pointer to next entry before deleting it in entry
             entry_t *next_entry = current_entry->next;
-            retain(next_entry);
 
             entry_destroy(ht, current_entry);
             // Update current entry with the pointer we previously saved
-            release(current_entry);
             current_entry = next_entry;
-            retain(next_entry);
-            release(next_entry);
         }
         // Remove pointer to next to avoid dangling pointer
         current_bucket->next = NULL;
     }
+    if (entries)
+    {
+        ht->size -= count;
+        release_many((obj **)entries, count);
+        release(entries);
+    }
     return;
 }
 
@@ -359,8 +363,7 @@ void ioopm_hash_table_apply_all(ioopm_hash_table_t *ht, ioopm_apply_function fun
 static entry_t *entry_create(ioopm_hash_table_t *ht, elem_t key, elem_t value, entry_t *next_entry)
 {
     // Allocate memory for new entry
-    entry_t *new_entry = allocate(sizeof(entry_t), NULL);
-    retain(new_entry);
+    entry_t *new_entry = allocate_owned(sizeof(entry_t), ioopm_no_destructor);
     *new_entry = (entry_t){.key = key, .next = next_entry, .value = value};
     ht->size += 1;
     return new_entry;
@@ -377,9 +380,9 @@ static entry_t *find_prev_entry_for_key(ioopm_hash_table_t *ht, elem_t key)
 {
     // Abs and modulo to get hash in range of buckets
     size_t bucket = ht->hash_fun(key) % Num_buckets;
-    // Initialize previous entry as the first entry passed by function
+    // Initialize previous entry as the first entry passed by function. It is
+    // part of the hashtable rather than an object, so it is never retained.
     entry_t *prev_entry = &ht->buckets[bucket];
-    retain(prev_entry);
     // Initialize current entry as the next entry
     entry_t *current_entry = prev_entry->next;
     retain(current_entry);
@@ -387,15 +390,12 @@ static entry_t *find_prev_entry_for_key(ioopm_hash_table_t *ht, elem_t key)
     // If current entry is null or key equal to current entrys key, break loop and return previous entry
     while (current_entry != NULL && !ht->key_eq_fun(current_entry->key, key))
     {
-        release(prev_entry);
         prev_entry = current_entry;
-        retain(prev_entry);
-        release(current_entry);
         current_entry = prev_entry->next;
         retain(current_entry);
+        release(prev_entry);
     }
     release(current_entry);
-    release(prev_entry);
     return prev_entry;
 }
 
@@ -478,9 +478,7 @@ static elem_t get_value(entry_t *current_entry)
 static void remove_entry(ioopm_hash_table_t *ht, entry_t *current_entry, entry_t *prev_entry)
 {
     entry_t *next_entry = current_entry->next;
-    retain(next_entry);
     prev_entry->next = next_entry;
-    //release(next_entry);
     entry_destroy(ht, current_entry);
 }
 
@@ -13,8 +13,7 @@
 
 ioopm_list_iterator_t *ioopm_list_iterator(ioopm_list_t *list)
 {
-    ioopm_list_iterator_t *result = allocate(sizeof(ioopm_list_t), NULL);
-    retain(result);
+    ioopm_list_iterator_t *result = allocate_owned(sizeof(ioopm_list_iterator_t), ioopm_no_destructor);
 
     // Assign current and list to result
     result->current = list->first;
@@ -65,7 +64,6 @@ elem_t ioopm_iterator_remove(ioopm_list_iterator_t *iter)
         iter->current = iter->previous;
         retain(iter->current);
         iter->list->last = iter->current;
-        retain(iter->list->last);
     }
 
     // Set current to next element
@@ -76,22 +74,18 @@ elem_t ioopm_iterator_remove(ioopm_list_iterator_t *iter)
     // First element in list
     if (iter->previous == NULL)
     {
-        release(iter->list->first);
         iter->list->first = iter->current;
-        retain(iter->list->first);
     }
     else
     {
         // Neither first or last element
-        release(iter->previous->tail);
         iter->previous->tail = iter->current;
-        retain(iter->previous->tail);
     }
 
     // Update size
     iter->list->size -= 1;
 
-    // Free element
+    // Free element, which the list owned
     release(to_remove);
 
     return result;
@@ -100,19 +94,14 @@ elem_t ioopm_iterator_remove(ioopm_list_iterator_t *iter)
 // Optional
 void ioopm_iterator_insert(ioopm_list_iterator_t *iter, elem_t element)
 {
-    ioopm_node_t *new_node = allocate(sizeof(ioopm_node_t), NULL);
-    retain(new_node); // 1
+    ioopm_node_t *new_node = allocate_owned(sizeof(ioopm_node_t), ioopm_no_destructor); // 1, owned by the list
     new_node->value = element;
 
     // If there is a previous node
     if (iter->previous != NULL)
     {
-        release(new_node->tail);
         new_node->tail = iter->current;
-        retain(new_node->tail);
-        release(iter->previous->tail);
         iter->previous->tail = new_node;
-        retain(iter->previous->tail);
     }
 
     // If new element is first (no previous node)
@@ -121,18 +110,13 @@ void ioopm_iterator_insert(ioopm_list_iterator_t *iter, elem_t element)
         // If there is another node that needs to be pointed at
         if (iter->current != NULL)
         {
-            release(new_node->tail);
             new_node->tail = iter->list->first;
-            retain(new_node->tail);
         }
         else
         {
-            release(iter->list->last);
             iter->list->last = new_node;
-            
         }
         // This is done after the if-statement so we don't lose the pointer to the first node
-        release(iter->list->first);
         iter->list->first = new_node;
 
     }
@@ -158,6 +142,10 @@ elem_t ioopm_iterator_current(ioopm_list_iterator_t *iter)
 
 void ioopm_iterator_destroy(ioopm_list_iterator_t *iter)
 {
+    // The iterator holds references to its nodes and list
+    release(iter->previous);
+    release(iter->current);
+    release(iter->list);
     release(iter);
     iter = NULL;
 }
@@ -64,8 +64,7 @@ static ioopm_node_t *swap(ioopm_node_t *node1, ioopm_node_t *node2);
 
 ioopm_list_t *ioopm_linkedlist_create(ioopm_eq_func eq_fun)
 {
-    ioopm_list_t *list = allocate(sizeof(ioopm_list_t), NULL);
-    retain(list);
+    ioopm_list_t *list = allocate_owned(sizeof(ioopm_list_t), ioopm_no_destructor);
     list->size = 0;
     list->eq_fun = eq_fun;
     return list;
@@ -206,7 +205,6 @@ elem_t ioopm_linkedlist_remove(ioopm_list_t *list, size_t index, bool *error)
         else if (list->size >= 2)
         {
             list->first = list->first->tail;
-            retain(list->first);
             destroy_node(current_node);
             release(current_node);
         }
@@ -232,7 +230,6 @@ elem_t ioopm_linkedlist_remove(ioopm_list_t *list, size_t index, bool *error)
         else
         {
             prev_node->tail = current_node->tail;
-            retain(prev_node->tail);
             destroy_node(current_node);
             release(prev_node);
         }
@@ -435,8 +432,7 @@ void ioopm_linkedlist_bubblesort(ioopm_list_t *list, int (*compare_fun)(elem_t a
 
 static ioopm_node_t *create_node(void)
 {
-    ioopm_node_t *new_node = allocate(sizeof(ioopm_node_t), NULL);
-    retain(new_node);
+    ioopm_node_t *new_node = allocate_owned(sizeof(ioopm_node_t), ioopm_no_destructor);
     new_node->tail = NULL;
     return new_node;
 }
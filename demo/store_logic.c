@@ -55,6 +55,10 @@ struct merch
 {
     char *name;
     char *desc;
+    // False while the string is the one in the merch's trailer, true once an
+    // edit has replaced it with an object of its own
+    bool owns_name;
+    bool owns_desc;
     ioopm_list_t *locations;
     int cost;
     size_t amount;
@@ -108,7 +112,7 @@ static void apply_store_shelves_destroy(elem_t key, elem_t *value, void *ignore)
 
 static void shelf_destroy(shelf_t *shelf);
 
-static void swap_and_free_old_string(char **old, char **new);
+static void swap_and_free_old_string(char **old, char **new, bool *owns_old);
 
 static cart_t *ioopm_create_cart(ioopm_store_t *store);
 
@@ -144,6 +148,8 @@ static void ioopm_checkout_merch(ioopm_store_t *store, merch_t *merch, size_t am
 
 static void remove_shelf(ioopm_store_t *store, shelf_t *shelf, merch_t *merch);
 
+static void remove_shelf_apply(size_t index, elem_t *value, void *store);
+
 static bool remove_cart_wares_from_store(ioopm_store_t *store, cart_t *cart);
 
 static int get_ware_amount(cart_t *cart, char *name);
@@ -162,8 +168,7 @@ static char *ref_strdup(char *src);
 
 ioopm_store_t *ioopm_store_create(void)
 {
-    ioopm_store_t *store = allocate(sizeof(ioopm_store_t), NULL);
-    retain(store);
+    ioopm_store_t *store = allocate_owned(sizeof(ioopm_store_t), ioopm_no_destructor);
 
     store->items = ioopm_hash_table_create(ioopm_djb2_hash, ioopm_string_equal, merch_equiv);
     store->shelves = ioopm_hash_table_create(ioopm_djb2_hash, ioopm_string_equal, shelf_equiv);
@@ -197,17 +202,12 @@ void ioopm_add_merch_to_store(ioopm_store_t *store, char *nameinput, char *desci
                               int cost)
 {
 
-    char *name = ref_strdup(nameinput);
-    char *description = ref_strdup(descinput);
-
-
-    merch_t *merch = ioopm_merch_create(name, description, cost);
+    // The merch keeps copies of the strings
+    merch_t *merch = ioopm_merch_create(nameinput, descinput, cost);
     retain(merch);
     elem_t key = str_elem(merch->name);
     elem_t value = merch_elem(merch);
     ioopm_hash_table_insert(store->items, key, value);
-    STRDUP_FREE(name);
-    STRDUP_FREE(description);
     release(merch);
 }
 
@@ -231,8 +231,10 @@ bool ioopm_merch_remove(ioopm_store_t *store, char *name)
     {
         
         ioopm_hash_table_remove(store->items, str_elem(name), &retur);
-        //merch_destroy(merch); 
+        // The merch's shelves are removed with it
+        ioopm_linkedlist_apply_all(merch->locations, remove_shelf_apply, store);
         release(merch);
+        merch_destroy(merch);
         return true;
     }
 }
@@ -258,8 +260,8 @@ void ioopm_merch_edit(ioopm_store_t *store, char *name, char *new_nameinput,
 
     edit_merch_in_shelf(merch, new_name);
 
-    swap_and_free_old_string(&merch->name, &new_name);
-    swap_and_free_old_string(&merch->desc, &new_description);
+    swap_and_free_old_string(&merch->name, &new_name, &merch->owns_name);
+    swap_and_free_old_string(&merch->desc, &new_description, &merch->owns_desc);
     merch->cost = new_price;
 
 
@@ -592,11 +594,19 @@ static bool cart_equal(elem_t value_a, elem_t value_b)
 
 static merch_t *ioopm_merch_create(char *name, char *description, int cost)
 {
-    merch_t *merch = allocate(sizeof(merch_t), NULL);
-    retain(merch);
-
-    merch->name = name;
-    merch->desc = description;
+    // The name and description are copied in after the struct, so that the
+    // merch is a single object
+    size_t name_size = strlen(name) + 1;
+    size_t desc_size = strlen(description) + 1;
+    merch_t *merch = allocate_ex(sizeof(merch_t), ioopm_no_destructor, REFMEM_OWNED, 0,
+                                 name_size + desc_size);
+
+    merch->name = (char *) (merch + 1);
+    memcpy(merch->name, name, name_size);
+    merch->desc = merch->name + name_size;
+    memcpy(merch->desc, description, desc_size);
+    merch->owns_name = false;
+    merch->owns_desc = false;
     merch->cost = cost;
     merch->amount = 0;
     merch->locations = ioopm_linkedlist_create(shelf_equiv);   // Empty list of shelves
@@ -617,9 +627,16 @@ static void apply_store_items_destroy(elem_t key, elem_t *merch, void *ignore)
 static void merch_destroy(merch_t *merch)
 {
     ioopm_linkedlist_destroy(merch->locations);
-    release(merch->locations);
-    release(merch->name);
-    release(merch->desc);
+    // Strings given by an edit are objects of their own, the ones the merch
+    // was created with are in its trailer
+    if (merch->owns_name)
+    {
+        release(merch->name);
+    }
+    if (merch->owns_desc)
+    {
+        release(merch->desc);
+    }
     release(merch);
 }
 
@@ -655,8 +672,7 @@ static void add_shelf_to_store(ioopm_store_t *store, char *name, char *shelfname
 static shelf_t *create_shelf(ioopm_store_t *store, char *name, char *shelfname,
                              int amount)
 {
-    shelf_t *shelf = allocate(sizeof(shelf_t), NULL);
-    retain(shelf);
+    shelf_t *shelf = allocate_owned(sizeof(shelf_t), ioopm_no_destructor);
 
     shelf->shelfname = shelfname;
     shelf->item = name;
@@ -719,19 +735,22 @@ static void shelf_destroy(shelf_t *shelf)
     release(shelf);
 }
 
-static void swap_and_free_old_string(char **old, char **new)
+static void swap_and_free_old_string(char **old, char **new, bool *owns_old)
 {
     char *tmp = *old;
     *old = *new;
-    STRDUP_FREE(tmp);
+    if (*owns_old)
+    {
+        STRDUP_FREE(tmp);
+    }
+    *owns_old = true;
 }
 
 static bool cart_is_empty(cart_t *cart) { return ioopm_hash_table_isempty(cart->wares); }
 
 static cart_t *ioopm_create_cart(ioopm_store_t *store)
 {
-    cart_t *cart = allocate(sizeof(cart_t), NULL);
-    retain(cart);
+    cart_t *cart = allocate_owned(sizeof(cart_t), ioopm_no_destructor);
     cart->id = store->cart_id_counter;
     update_cart_counter(store);
 
@@ -936,6 +955,11 @@ static void remove_shelf(ioopm_store_t *store, shelf_t *shelf, merch_t *merch)
     shelf_destroy(shelf);
 }
 
+static void remove_shelf_apply(size_t index, elem_t *value, void *store)
+{
+    remove_shelf(store, value->p, NULL);
+}
+
 static void ioopm_checkout_merch(ioopm_store_t *store, merch_t *merch, size_t amount)
 {
     ioopm_list_t *merch_locations = NULL;
@@ -1098,8 +1122,7 @@ static int strcomp(elem_t x, elem_t y) { return strcmp((char *) x.p, (char *) y.
 static char *ref_strdup(char *src)
 {
     size_t len = strlen(src);
-    char *str = allocate_array(len + 1, sizeof(char), NULL);
-    retain(str);
+    char *str = allocate_ex(len + 1, ioopm_no_destructor, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
     strcpy(str, src);
     return str;
 }
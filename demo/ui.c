@@ -418,7 +418,7 @@ static bool valid_char(char buffert, char *valid_characters)
 
 static char *stringcat(char *string1, char *string2)
 {
-    char *string_cat = allocate_array(strlen(string1) + strlen(string2) + 1, sizeof(char), NULL);
+    char *string_cat = allocate_array_uninit(strlen(string1) + strlen(string2) + 1, sizeof(char), NULL);
     strcpy(string_cat, string1);
     strcat(string_cat, string2);
     return string_cat;
@@ -547,8 +547,7 @@ static bool store_is_empty_check(ioopm_store_t *store)
 static char *ref_strdup(char *src)
 {
     size_t len = strlen(src);
-    char *str = allocate_array(len + 1, sizeof(char), NULL);
-    retain(str);
+    char *str = allocate_ex(len + 1, NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
     strcpy(str, src);
     return str;
 }
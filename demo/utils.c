@@ -154,8 +154,7 @@ void print(char *str)
 static char *ref_strdup(char *src)
 {
     size_t len = strlen(src);
-    char *str = allocate_array(len + 1, sizeof(char), NULL);
-    retain(str);
+    char *str = allocate_ex(len + 1, NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
     strcpy(str, src);
     return str;
 }
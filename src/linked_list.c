@@ -32,17 +32,15 @@ void ref_linked_list_destroy(ref_list_t *list)
 {
     link_t *current = list->first;
 
-    /* If there exists a (first) link; set first to the next link and free the
-       link, then destroy the remaining list */
-    if (current != NULL) {
-        list->first = current->next;
+    /* Free the links one at a time; recursing once per link would overflow
+       the stack for long lists */
+    while (current != NULL) {
+        link_t *next = current->next;
         free(current);
-        ref_linked_list_destroy(list);
-    }
-    /* If the list is empty, free the list */
-    else {
-        free(list);
+        current = next;
     }
+    /* When all links are freed, free the list */
+    free(list);
 }
 
 
@@ -197,6 +195,37 @@ ref_elem_t ref_linked_list_remove(ref_list_t *list, int index)
 }
 
 
+size_t ref_linked_list_remove_all(ref_list_t *list,
+                                  ref_elem_predicate prop,
+                                  void *extra)
+{
+    size_t removed = 0;
+    link_t *prev = NULL;
+    link_t *current = list->first;
+    /* Unlink and free every link the predicate holds for, keeping track of
+       the last link that stays */
+    while (current != NULL) {
+        link_t *next = current->next;
+        if (prop(list, current->value, extra)) {
+            if (prev == NULL) {
+                list->first = next;
+            }
+            else {
+                prev->next = next;
+            }
+            free(current);
+            removed++;
+        }
+        else {
+            prev = current;
+        }
+        current = next;
+    }
+    list->last = prev;
+    list->size -= removed;
+    return removed;
+}
+
 ref_elem_t ref_linked_list_get(ref_list_t *list, int index)
 {
     /* Adjust index */
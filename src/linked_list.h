@@ -75,6 +75,16 @@ void ref_linked_list_insert(ref_list_t *list, int index, ref_elem_t value);
 /// @return the value removed
 ref_elem_t ref_linked_list_remove(ref_list_t *list, int index);
 
+/// @brief Remove every element for which a supplied property holds, in one
+/// walk of the list, i.e. in O(n) time however many are removed.
+/// @param list the linked list
+/// @param prop the property of the elements to be removed
+/// @param extra an additional argument (may be NULL) that will be passed to
+/// all internal calls of prop
+/// @return the number of elements removed
+size_t ref_linked_list_remove_all(ref_list_t *list, ref_elem_predicate prop,
+                                  void *extra);
+
 /// @brief Retrieve an element from a linked list in O(n) time. The valid
 /// values of index are [0,n-1] for a list of n elements, where 0 means the
 /// first element and n-1 means the last element. If index is out of bound, it
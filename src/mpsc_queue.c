@@ -0,0 +1,49 @@
+#include <stddef.h>
+#include "mpsc_queue.h"
+
+void ref_mpsc_push(ref_mpsc_queue_t *queue, ref_mpsc_node_t *node)
+{
+    atomic_store(&node->next, NULL);
+    ref_mpsc_node_t *previous = atomic_exchange(&queue->head, node);
+    atomic_store(&previous->next, node);
+}
+
+ref_mpsc_node_t *ref_mpsc_pop(ref_mpsc_queue_t *queue)
+{
+    ref_mpsc_node_t *first = queue->tail;
+    ref_mpsc_node_t *next = atomic_load(&first->next);
+    if (first == &queue->stub)
+    {
+        if (next == NULL)
+        {
+            return NULL;
+        }
+        queue->tail = next;
+        first = next;
+        next = atomic_load(&next->next);
+    }
+    if (next != NULL)
+    {
+        queue->tail = next;
+        return first;
+    }
+    /* first is the only node that is fully linked in. It can only be taken
+       once another node follows it, so the stub is pushed behind it */
+    if (first != atomic_load(&queue->head))
+    {
+        return NULL;
+    }
+    ref_mpsc_push(queue, &queue->stub);
+    next = atomic_load(&first->next);
+    if (next != NULL)
+    {
+        queue->tail = next;
+        return first;
+    }
+    return NULL;
+}
+
+bool ref_mpsc_is_empty(ref_mpsc_queue_t *queue)
+{
+    return queue->tail == &queue->stub && atomic_load(&queue->head) == &queue->stub;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/**
+ * @file mpsc_queue.h
+ * @brief Intrusive lock-free multi-producer single-consumer queue.
+ *
+ * This is Vyukov's queue: a producer swaps its node in as the head and then
+ * links the previous head to it, the consumer takes nodes from the tail. A
+ * stub node keeps the queue from ever being empty, so a push never touches
+ * the tail. Any number of threads may push at once, but only one may pop at
+ * a time.
+ *
+ * The nodes are embedded in the structs that are queued. A struct must not
+ * be pushed again before it has been popped.
+ */
+
+typedef struct ref_mpsc_node ref_mpsc_node_t;
+struct ref_mpsc_node
+{
+    _Atomic(ref_mpsc_node_t *) next;
+};
+
+typedef struct ref_mpsc_queue ref_mpsc_queue_t;
+struct ref_mpsc_queue
+{
+    /// @brief The most recently pushed node, written by producers
+    _Atomic(ref_mpsc_node_t *) head;
+    /// @brief The next node to pop, only touched by the consumer
+    ref_mpsc_node_t *tail;
+    ref_mpsc_node_t stub;
+};
+
+/// @brief Initializer for an empty queue, e.g.
+///        `static ref_mpsc_queue_t queue = REF_MPSC_QUEUE_INIT(queue);`
+#define REF_MPSC_QUEUE_INIT(queue) {.head = &(queue).stub, .tail = &(queue).stub}
+
+/// @brief Add a node to the queue, from any thread
+/// @param queue the queue
+/// @param node the node to add
+void ref_mpsc_push(ref_mpsc_queue_t *queue, ref_mpsc_node_t *node);
+
+/// @brief Take the oldest node off the queue, from the consumer thread
+/// @param queue the queue
+/// @return the node, or NULL if the queue is empty or the only node in it is
+///         still being pushed
+ref_mpsc_node_t *ref_mpsc_pop(ref_mpsc_queue_t *queue);
+
+/// @brief Whether nothing has been pushed that was not popped, including
+///        pushes that are still in progress. Called by the consumer.
+/// @param queue the queue
+/// @return true if the queue is empty
+bool ref_mpsc_is_empty(ref_mpsc_queue_t *queue);
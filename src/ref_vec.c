@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <string.h>
+#include "ref_vec.h"
+
+// The number of elements a new vector has room for
+#define INITIAL_CAPACITY 8
+
+struct ref_vec
+{
+    size_t length;
+    size_t capacity;
+    size_t elem_size;
+    char *data;
+};
+
+/// @brief The buffer holds copies that the vector does not own, so it is
+///        freed without releasing anything
+static void data_destructor(obj *data)
+{
+}
+
+static void vec_destructor(obj *object)
+{
+    release(((ref_vec_t *)object)->data);
+}
+
+ref_vec_t *ref_vec_create(size_t elem_size)
+{
+    ref_vec_t *vec = allocate_owned(sizeof(ref_vec_t), vec_destructor);
+    if (!vec)
+    {
+        return NULL;
+    }
+    vec->elem_size = elem_size;
+    vec->data = allocate_ex(refmem_array_size(INITIAL_CAPACITY, elem_size), data_destructor,
+                            REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
+    if (!vec->data)
+    {
+        release(vec);
+        return NULL;
+    }
+    vec->capacity = INITIAL_CAPACITY;
+    return vec;
+}
+
+bool ref_vec_push(ref_vec_t *vec, const void *elem)
+{
+    if (vec->length == vec->capacity)
+    {
+        if (vec->elem_size && vec->capacity > SIZE_MAX / 2 / vec->elem_size)
+        {
+            return false;
+        }
+        char *grown = reallocate(vec->data, 2 * vec->capacity * vec->elem_size);
+        if (!grown)
+        {
+            return false;
+        }
+        vec->data = grown;
+        vec->capacity *= 2;
+    }
+    memcpy(vec->data + vec->length * vec->elem_size, elem, vec->elem_size);
+    vec->length++;
+    return true;
+}
+
+bool ref_vec_pop(ref_vec_t *vec, void *elem)
+{
+    if (vec->length == 0)
+    {
+        return false;
+    }
+    vec->length--;
+    if (elem)
+    {
+        memcpy(elem, vec->data + vec->length * vec->elem_size, vec->elem_size);
+    }
+    return true;
+}
+
+void *ref_vec_get(ref_vec_t *vec, size_t index)
+{
+    return index < vec->length ? vec->data + index * vec->elem_size : NULL;
+}
+
+size_t ref_vec_length(ref_vec_t *vec)
+{
+    return vec->length;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "refmem.h"
+
+/**
+ * @file ref_vec.h
+ * @brief A growable array that is itself a refmem object.
+ *
+ * The vector is a small header object that holds the elements in a buffer
+ * object of its own. When the buffer is full, it is doubled with reallocate,
+ * so a push costs amortised O(1) and the vector keeps its address however
+ * far it grows. Only the header points to the buffer, so nothing else has to
+ * be updated when the buffer moves.
+ *
+ * Elements are copied in and out by value. A vector of pointers does not
+ * retain or release the objects they point to.
+ */
+
+typedef struct ref_vec ref_vec_t;
+
+/// @brief Create an empty vector
+/// @param elem_size the size of every element
+/// @return the vector, with reference count 1, or NULL if out of memory
+ref_vec_t *ref_vec_create(size_t elem_size);
+
+/// @brief Append an element to the end of a vector
+/// @param vec the vector
+/// @param elem the element to copy in
+/// @return false if the vector could not grow, which leaves it as it was
+bool ref_vec_push(ref_vec_t *vec, const void *elem);
+
+/// @brief Remove the last element of a vector
+/// @param vec the vector
+/// @param elem where the element is copied to, or NULL
+/// @return false if the vector is empty
+bool ref_vec_pop(ref_vec_t *vec, void *elem);
+
+/// @brief Get an element of a vector. The pointer is valid until the vector
+///        next grows.
+/// @param vec the vector
+/// @param index the index of the element
+/// @return a pointer to the element, or NULL if index is out of range
+void *ref_vec_get(ref_vec_t *vec, size_t index);
+
+/// @brief The number of elements in a vector
+/// @param vec the vector
+/// @return the number of elements
+size_t ref_vec_length(ref_vec_t *vec);
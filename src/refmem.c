@@ -1,10 +1,31 @@
+#include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "refmem.h"
+#include "refmem_collector.h"
+#include "refmem_epoch.h"
+#include "refmem_hooks.h"
 #include "refmem_internal.h"
+#include "refmem_pause.h"
+#include "refmem_record.h"
+#include "refmem_remote.h"
 #include "linked_list.h"
 
+// This file defines the functions that REFMEM_TRACK_SITES replaces with macros
+#undef allocate
+#undef allocate_array
+#undef allocate_owned
+#undef allocate_array_owned
+#undef allocate_uninit
+#undef allocate_array_uninit
+#undef allocate_aligned
+#undef allocate_array_aligned
+#undef allocate_with_trailer
+#undef allocate_ex
+
 // Remove all instances of the static keyword for refmem unittests
 #ifdef REFMEM_DISABLE_STATIC
 // Replace static with nothing
@@ -13,8 +34,114 @@
 
 static ref_list_t *object_list = NULL;
 static ref_list_t *ptr_list = NULL;
+
+// Object structs are carved out of large chunks, so the reference counts
+// that retain and release write share pages with each other rather than
+// with payloads, which a forked child can then keep sharing
+#define STRUCTS_PER_CHUNK 4096
+
+typedef struct struct_chunk struct_chunk_t;
+struct struct_chunk
+{
+    struct_chunk_t *next;
+    object_t structs[STRUCTS_PER_CHUNK];
+};
+
+static struct_chunk_t *struct_chunks = NULL;
+// The number of structs handed out from the newest chunk
+static size_t chunk_used = STRUCTS_PER_CHUNK;
+// Freed structs, linked through their object field
+static object_t *free_structs = NULL;
 static size_t cascade_limit = SIZE_MAX;
 static size_t freed_objects = 0;
+// Structs of objects that a sweep has freed but not yet unlinked
+static size_t dead_structs = 0;
+static bool shutdown_destructors = false;
+static size_t shutdown_threads = 1;
+// Set while shutdown() runs destructors, which makes retain and release no-ops
+static bool shutting_down = false;
+unsigned refmem_slow_paths = 0;
+
+// Held by every refmem call, and by the collector thread while it unlinks and
+// frees an object, for as long as the collector runs
+static pthread_mutex_t heap_lock;
+static pthread_once_t heap_lock_once = PTHREAD_ONCE_INIT;
+
+static void init_heap_lock(void)
+{
+    /* Recursive, since destructors call back into refmem */
+    pthread_mutexattr_t attributes;
+    pthread_mutexattr_init(&attributes);
+    pthread_mutexattr_settype(&attributes, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&heap_lock, &attributes);
+    pthread_mutexattr_destroy(&attributes);
+}
+
+bool refmem_lock_heap(void)
+{
+    if (!refmem_collector_running())
+    {
+        return false;
+    }
+    pthread_once(&heap_lock_once, init_heap_lock);
+    pthread_mutex_lock(&heap_lock);
+    return true;
+}
+
+void refmem_unlock_heap(bool locked)
+{
+    if (locked)
+    {
+        pthread_mutex_unlock(&heap_lock);
+    }
+}
+
+/// @brief Get a zeroed object struct
+/// @return the struct, NULL if out of memory
+static object_t *new_struct(void)
+{
+    object_t *object_struct = free_structs;
+    if (object_struct)
+    {
+        free_structs = object_struct->object;
+    }
+    else
+    {
+        if (chunk_used == STRUCTS_PER_CHUNK)
+        {
+            struct_chunk_t *chunk = malloc(sizeof(struct_chunk_t));
+            if (!chunk)
+            {
+                return NULL;
+            }
+            chunk->next = struct_chunks;
+            struct_chunks = chunk;
+            chunk_used = 0;
+        }
+        object_struct = &struct_chunks->structs[chunk_used++];
+    }
+    memset(object_struct, 0, sizeof(object_t));
+    return object_struct;
+}
+
+static void free_struct(object_t *object_struct)
+{
+    object_struct->object = free_structs;
+    free_structs = object_struct;
+}
+
+/// @brief Free every object struct at once, whether in use or not
+static void free_all_structs(void)
+{
+    while (struct_chunks)
+    {
+        struct_chunk_t *next = struct_chunks->next;
+        free(struct_chunks);
+        struct_chunks = next;
+    }
+    chunk_used = STRUCTS_PER_CHUNK;
+    free_structs = NULL;
+}
 
 static bool eq_fun(ref_elem_t ptr, ref_elem_t other_ptr)
 {
@@ -43,16 +170,40 @@ static void add_ptr_to_memory(obj *to_save)
 ///        This is used when the default destructor is in use.
 /// @param to_remove the pointer to remove from the ptr_list.
 
+typedef struct lookup lookup_t;
+struct lookup
+{
+    /// @brief The pointer or object that is looked for
+    obj *object;
+    /// @brief The list element that matched
+    void *found;
+    /// @brief The index of the element, or the number of elements walked
+    int index;
+};
+
+static bool is_ptr(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    lookup_t *lookup = extra;
+    if (value.p == lookup->object)
+    {
+        lookup->found = value.p;
+        return true;
+    }
+    lookup->index++;
+    return false;
+}
+
 static void remove_ptr_from_memory(obj *to_remove)
 {
     if (ptr_list)
     {
-        for (int i = 0; i < ref_linked_list_size(ptr_list); i += 1)
+        /* Each object is added once and removed when it is freed, so the walk
+           stops at the first match. Objects are usually freed in allocation
+           order, which puts the match at the front. */
+        lookup_t lookup = {.object = to_remove};
+        if (ref_linked_list_any(ptr_list, is_ptr, &lookup))
         {
-            if (ref_linked_list_get(ptr_list, i).p == to_remove)
-            {
-                ref_linked_list_remove(ptr_list, i);
-            }
+            ref_linked_list_remove(ptr_list, lookup.index);
         }
         if (ref_linked_list_size(ptr_list) == 0)
         {
@@ -62,24 +213,126 @@ static void remove_ptr_from_memory(obj *to_remove)
     }
 }
 
-/// @brief Get an object's struct from object_list
+/// @brief Replace a pointer in ptr_list with the new address of its object,
+///        keeping its place in the list
+static void move_ptr_in_memory(obj *from, obj *to)
+{
+    lookup_t lookup = {.object = from};
+    if (ptr_list && ref_linked_list_any(ptr_list, is_ptr, &lookup))
+    {
+        ref_linked_list_remove(ptr_list, lookup.index);
+        ref_linked_list_insert(ptr_list, lookup.index, (ref_elem_t){.p = to});
+    }
+}
+
+static bool is_struct_of(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    lookup_t *lookup = extra;
+    if (((object_t *)value.p)->object == lookup->object)
+    {
+        lookup->found = value.p;
+        return true;
+    }
+    lookup->index++;
+    return false;
+}
+
+/// @brief Find an object's struct and its index in object_list, walking the
+///        list once
+/// @param object the object whose struct we want to find
+/// @param lookup where the struct and index are stored
+/// @return true if the object's struct is found
+static bool find_struct(obj *object, lookup_t *lookup)
+{
+    *lookup = (lookup_t){.object = object};
+    return object && object_list && ref_linked_list_any(object_list, is_struct_of, lookup);
+}
+
+/// @brief Get an object's struct from object_list. REFMEM_FAST builds take
+///        any pointer but NULL to be an object and read its header instead.
 /// @param object the object whose struct we want to get
 /// @return the object's struct or, if the there is no such, NULL
 static object_t *get_struct(obj *object)
 {
-    if (object && object_list)
+#ifdef REFMEM_FAST
+    return object ? refmem_header(object) : NULL;
+#else
+    lookup_t lookup;
+    return find_struct(object, &lookup) ? lookup.found : NULL;
+#endif
+}
+
+#ifdef REFMEM_CHECKED
+// The number of freed payloads that are kept poisoned before they are given
+// back to malloc
+#define QUARANTINE_SIZE 1024
+// The byte written over every freed payload
+#define POISON 0xdd
+
+typedef struct quarantined quarantined_t;
+struct quarantined
+{
+    /// @brief The memory of the payload and its header, to be freed
+    void *block;
+    obj *object;
+    size_t size;
+};
+
+// Freed payloads, the oldest at quarantine_next once all slots are used
+static quarantined_t quarantine[QUARANTINE_SIZE];
+static size_t quarantine_next = 0;
+
+static bool points_into(obj *start, size_t size, obj *pointer)
+{
+    return pointer == start ||
+           ((char *)pointer > (char *)start && (char *)pointer < (char *)start + size);
+}
+
+static bool is_inside(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    object_t *object_struct = value.p;
+    return points_into(object_struct->object, object_struct->size, extra);
+}
+
+/// @brief Stop the program on a pointer that was given to a refmem function
+///        but is not an object
+/// @param pointer the pointer, not NULL
+/// @param operation the name of the function it was given to
+static void check_pointer(obj *pointer, const char *operation)
+{
+    for (size_t i = 0; i < QUARANTINE_SIZE; i++)
     {
-        object_t *current_struct;
-        for (int i = 0; i <= ref_linked_list_size(object_list); i++)
+        if (quarantine[i].block && points_into(quarantine[i].object, quarantine[i].size, pointer))
         {
-            current_struct = ref_linked_list_get(object_list, i).p;
-            if (current_struct->object == object)
-            {
-                return current_struct;
-            }
+            fprintf(stderr, "refmem: %s of %p, which has already been freed\n", operation, pointer);
+            abort();
         }
     }
-    return NULL;
+    if (object_list && ref_linked_list_any(object_list, is_inside, pointer))
+    {
+        fprintf(stderr, "refmem: %s of %p, which points into an object\n", operation, pointer);
+        abort();
+    }
+    fprintf(stderr, "refmem: %s of %p, which refmem did not allocate\n", operation, pointer);
+    abort();
+}
+#endif
+
+/// @brief Get the struct of an object given to one of the functions in
+///        refmem.h, see get_struct. REFMEM_CHECKED builds check the pointer.
+/// @param object the object
+/// @param operation the name of the function, for the error message
+/// @return the object's struct or, if the there is no such, NULL
+static object_t *find_object(obj *object, const char *operation)
+{
+    object_t *object_struct = get_struct(object);
+#ifdef REFMEM_CHECKED
+    if (!object_struct && object)
+    {
+        check_pointer(object, operation);
+    }
+#endif
+    return object_struct;
 }
 
 /// @brief  A default destructor that is used when NULL is given as an objects
@@ -89,13 +342,17 @@ static object_t *get_struct(obj *object)
 /// @param o the object to destroy.
 static void default_destructor(obj *o)
 {
-    object_t *object_struct = get_struct(o);
+    /* Only refmem runs it, on objects it allocated, so the struct is read
+       from the header rather than looked up */
+    object_t *object_struct = o ? refmem_header(o) : NULL;
 
-    if (!object_struct)
+    /* Only the part that may hold pointers is scanned. An uninitialised
+       payload may hold anything, including stale addresses, and is not. */
+    if (!object_struct || object_struct->scan_size < sizeof(void *))
     {
         return;
     }
-    size_t size = object_struct->size;
+    size_t size = object_struct->scan_size;
 
     unsigned long long start_memory = (unsigned long long)o;
     unsigned long long end_memory = start_memory + size - sizeof(void *);
@@ -110,7 +367,8 @@ static void default_destructor(obj *o)
         }
         potential_ptr = (void **)p;
 
-        if (potential_ptr) {
+        /* NULL is never an object, so zeroed words need no lookup */
+        if (*potential_ptr) {
             if (ref_linked_list_contains(ptr_list, (ref_elem_t ){.p = *potential_ptr})){
                     // we found a match, this is the ptr we want to release.
                     release(*potential_ptr);
@@ -126,44 +384,53 @@ static void default_destructor(obj *o)
 
 static bool get_struct_index(obj *object, int *index)
 {
-    if (object && object_list)
+    lookup_t lookup;
+    if (find_struct(object, &lookup))
     {
-        object_t *current_struct;
-        for (int i = 0; i < ref_linked_list_size(object_list); i++)
-        {
-            current_struct = ref_linked_list_get(object_list, i).p;
-            if (current_struct->object == object)
-            {
-                *index = i;
-                return true;
-            }
-        }
+        *index = lookup.index;
+        return true;
     }
     return false;
 }
 
 void retain(obj *object)
 {
-    object_t *object_struct = get_struct(object);
-    if (object_struct)
+    if (shutting_down)
+    {
+        return;
+    }
+    bool locked = refmem_lock_heap();
+    object_t *object_struct = find_object(object, "retain");
+    if (object_struct && !object_struct->immortal)
     {
+        refmem_record_object(REFMEM_TRACE_RETAIN, object);
         object_struct->rc++;
+        REFMEM_HOOK(on_retain, object, object_struct->rc);
     }
+    refmem_unlock_heap(locked);
 }
 
+static void deallocate_struct(object_t *to_deallocate);
+
 void release(obj *object)
 {
-    object_t *object_struct = get_struct(object);
-    if (object_struct)
+    if (shutting_down)
     {
-        if (rc(object) > 0)
+        return;
+    }
+    bool locked = refmem_lock_heap();
+    object_t *object_struct = find_object(object, "release");
+    if (object_struct && !object_struct->immortal)
+    {
+        refmem_record_object(REFMEM_TRACE_RELEASE, object);
+        if (object_struct->rc > 0)
         {
             object_struct->rc--;
         }
-        if (rc(object) == 0)
+        REFMEM_HOOK(on_release, object, object_struct->rc);
+        if (object_struct->rc == 0)
         {
-            remove_ptr_from_memory(object);
-            deallocate(object);
+            deallocate_struct(object_struct);
         }
     }
     if (object_list != NULL && ref_linked_list_size(object_list) == 0)
@@ -171,69 +438,388 @@ void release(obj *object)
         ref_linked_list_destroy(object_list);
         object_list = NULL;
     }
+    refmem_unlock_heap(locked);
 }
 
 size_t rc(obj *object)
 {
-    struct object *struct_object = get_struct(object);
+    bool locked = refmem_lock_heap();
+    object_t *object_struct = find_object(object, "rc");
+    /* This might cause problems, since 0 "signals" that we need to deallocate */
+    size_t count = object_struct ? object_struct->rc : 0;
+    refmem_unlock_heap(locked);
+    return count;
+}
 
-    if (!object || !struct_object->object)
+/// @brief Account for an object that is about to be freed
+/// @param object_struct the struct of the object
+static void note_free(object_t *object_struct)
+{
+    REFMEM_HOOK(on_free, object_struct->object, object_struct->size);
+    refmem_pause_note_free(object_struct->size);
+    if (object_struct->site)
+    {
+        refmem_site_note_free(object_struct->site, object_struct->size);
+    }
+    if (object_struct->sample)
     {
-        return 0; /* This might cause problems, since it "signals" that we need to deallocate. */
+        refmem_sample_free(object_struct->sample);
     }
+}
 
-    return struct_object->rc;
+/* The bytes in front of a payload, which end with the address of the
+   object's struct (see refmem_header). A whole unit of malloc's alignment, so
+   that the payload keeps the block's alignment. */
+#define HEADER_SIZE _Alignof(max_align_t)
+
+/* An over-aligned payload also keeps the start of its block in the header */
+_Static_assert(2 * sizeof(void *) <= HEADER_SIZE, "the header holds two pointers");
+
+/// @brief Whether a payload needs more alignment than malloc gives
+/// @param alignment The alignment of the payload, or 0 for that of malloc
+static bool over_aligned(size_t alignment)
+{
+    return alignment > _Alignof(max_align_t);
 }
 
-static void destroy_object(object_t *object_struct)
+/// @brief The number of bytes a payload's block holds beyond the payload
+/// @param alignment The alignment of the payload, or 0 for that of malloc
+static size_t payload_padding(size_t alignment)
 {
+    /* An over-aligned payload goes at the first aligned address that leaves
+       room for the header, which is at most alignment bytes into the block */
+    return over_aligned(alignment) ? alignment : HEADER_SIZE;
+}
+
+/// @brief Get the start of the memory of a payload and its header
+/// @param object the payload
+/// @param alignment the alignment it was allocated with
+static char *payload_block(obj *object, size_t alignment)
+{
+    return over_aligned(alignment) ? ((char **)object)[-2] : (char *)object - HEADER_SIZE;
+}
+
+/// @brief Free the memory of an object's payload and its header
+/// @param object_struct the struct of the object
+static void free_payload(object_t *object_struct)
+{
+    free(payload_block(object_struct->object, object_struct->alignment));
+}
+
+/// @brief Give up the payload of an object that has been destroyed.
+///        REFMEM_CHECKED builds poison it and keep it for a while, so that a
+///        later release of the object is caught.
+/// @param object_struct the struct of the object
+static void retire_payload(object_t *object_struct)
+{
+#ifdef REFMEM_CHECKED
+    char *block = payload_block(object_struct->object, object_struct->alignment);
+    memset(block, POISON, (char *)object_struct->object - block + object_struct->size);
+    quarantined_t *oldest = &quarantine[quarantine_next];
+    free(oldest->block);
+    *oldest = (quarantined_t){
+        .block = block, .object = object_struct->object, .size = object_struct->size};
+    quarantine_next = (quarantine_next + 1) % QUARANTINE_SIZE;
+#else
+    free_payload(object_struct);
+#endif
+}
+
+/// @brief Free every payload kept by retire_payload
+static void empty_quarantine(void)
+{
+#ifdef REFMEM_CHECKED
+    for (size_t i = 0; i < QUARANTINE_SIZE; i++)
+    {
+        free(quarantine[i].block);
+        quarantine[i] = (quarantined_t){0};
+    }
+    quarantine_next = 0;
+#endif
+}
+
+/// @brief Run an object's destructor, recording it in the trace
+/// @param object_struct the struct of the object
+static void run_object_destructor(object_t *object_struct)
+{
+    refmem_record_object(REFMEM_TRACE_DESTROY, object_struct->object);
     object_struct->destructor(object_struct->object);
+    refmem_record_destroyed(object_struct->object);
+}
+
+/// @brief Remove an object whose destructor has run from object_list and
+///        free it
+/// @param object_struct the struct of the object
+static void free_destroyed(object_t *object_struct)
+{
+    /* The destructor may have freed other objects and moved this one, so it
+       is looked up again */
+    int index;
+    if (get_struct_index(object_struct->object, &index))
+    {
+        ref_linked_list_remove(object_list, index);
+    }
 
-    free(object_struct->object);
-    free(object_struct);
+    note_free(object_struct);
+    retire_payload(object_struct);
+    free_struct(object_struct);
 }
 
-/// @brief Clean up up to `limit` objects with reference count 0
-/// @param start_index The list index to start cleanup at
-/// @param limit The maximum number of objects to deallocate
-/// @return The combined size (in bytes) of all cleaned-up objects
-static size_t cleanup_helper(size_t start_index, size_t limit, size_t cleaned_up)
+/// @brief Run an object's destructor, then remove it from object_list and
+///        free it
+/// @param object_struct the struct of the object
+static void destroy_object(object_t *object_struct)
 {
-    if (object_list == NULL || limit == 0 || start_index >= ref_linked_list_size(object_list))
+    /* The pointer goes first, so that the default destructor of an object
+       that points to itself does not release it again */
+    remove_ptr_from_memory(object_struct->object);
+    run_object_destructor(object_struct);
+    free_destroyed(object_struct);
+}
+
+static int compare_pointers(const void *a, const void *b)
+{
+    uintptr_t x = (uintptr_t)*(obj *const *)a;
+    uintptr_t y = (uintptr_t)*(obj *const *)b;
+    return (x > y) - (x < y);
+}
+
+/// @brief Whether a sorted array of pointers holds a pointer
+static bool contains_pointer(obj **sorted, size_t count, obj *pointer)
+{
+    size_t low = 0;
+    size_t high = count;
+    while (low < high)
     {
-        return cleaned_up;
+        size_t middle = low + (high - low) / 2;
+        if ((uintptr_t)sorted[middle] < (uintptr_t)pointer)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
     }
-    else
+    return low < count && sorted[low] == pointer;
+}
+
+// The garbage a sweep frees at a time if there is no memory for more
+#define SWEEP_FALLBACK 64
+
+typedef struct sweep sweep_t;
+struct sweep
+{
+    /// @brief The structs of the garbage found, oldest first
+    object_t **found;
+    /// @brief Their payloads, sorted by address
+    obj **payloads;
+    size_t count;
+    size_t capacity;
+};
+
+static bool collect_garbage(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    sweep_t *sweep = extra;
+    object_t *object_struct = value.p;
+    /* Objects waiting to be freed belong to the collector or release_many,
+       frozen ones are never garbage, and those with remote releases queued
+       are freed once they are drained. Marked, so that the destructors of
+       objects freed before it do not free it through release or deallocate. */
+    if (object_struct->rc == 0 && !object_struct->free_pending && !object_struct->immortal &&
+        atomic_load(&object_struct->remote_releases) == 0)
+    {
+        object_struct->free_pending = true;
+        sweep->payloads[sweep->count] = object_struct->object;
+        sweep->found[sweep->count++] = object_struct;
+    }
+    return sweep->count == sweep->capacity;
+}
+
+static bool is_swept_pointer(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    sweep_t *sweep = extra;
+    return contains_pointer(sweep->payloads, sweep->count, value.p);
+}
+
+/// @brief Unlink the structs of the objects a sweep has freed and free them
+static bool unlink_dead(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    object_t *object_struct = value.p;
+    if (object_struct->object)
+    {
+        return false;
+    }
+    free_struct(object_struct);
+    dead_structs--;
+    return true;
+}
+
+/// @brief Free the garbage a sweep found, see cleanup_helper
+/// @return The combined size (in bytes) of the objects freed
+static size_t free_garbage(sweep_t *sweep)
+{
+    /* The pointers go first, so that the default destructors do not release
+       an object that points to itself, or another one of the garbage */
+    qsort(sweep->payloads, sweep->count, sizeof(obj *), compare_pointers);
+    if (ptr_list)
     {
-        object_t *object_struct = ref_linked_list_get(object_list, start_index).p;
-        if (rc(object_struct->object) == 0)
+        ref_linked_list_remove_all(ptr_list, is_swept_pointer, sweep);
+    }
+
+    size_t freed = 0;
+    for (size_t i = 0; i < sweep->count; i++)
+    {
+        object_t *object_struct = sweep->found[i];
+        if (object_struct->rc > 0)
         {
-            size_t object_size = object_struct->size;
+            /* A destructor run before retained it again */
+            object_struct->free_pending = false;
+            add_ptr_to_memory(object_struct->object);
+            continue;
+        }
+        /* Still marked while its destructor runs, so that a sweep it starts
+           by allocating does not free it again */
+        run_object_destructor(object_struct);
+        freed += object_struct->size;
+        note_free(object_struct);
+        retire_payload(object_struct);
+        /* Left in object_list, where no lookup matches it, until it is
+           unlinked along with the rest */
+        object_struct->object = NULL;
+        object_struct->size = 0;
+        dead_structs++;
+    }
 
-            destroy_object(object_struct);
-            ref_linked_list_remove(object_list, start_index);
+    /* Destructors may have run sweeps of their own that unlinked them */
+    if (dead_structs > 0)
+    {
+        ref_linked_list_remove_all(object_list, unlink_dead, NULL);
+    }
+    if (ptr_list && ref_linked_list_size(ptr_list) == 0)
+    {
+        ref_linked_list_destroy(ptr_list);
+        ptr_list = NULL;
+    }
+    return freed;
+}
 
-            if (ref_linked_list_size(object_list) == 0) {
-                ref_linked_list_destroy(object_list);
-                object_list = NULL;
-            }
+/// @brief Clean up up to `limit` objects with reference count 0. The garbage
+///        is collected in one walk of object_list, freed oldest first, and
+///        unlinked from object_list and ptr_list in one more walk of each, so
+///        that a sweep is linear in the number of objects however many of
+///        them are garbage. Garbage the destructors leave is collected by
+///        another walk.
+/// @param limit The maximum number of objects to deallocate
+/// @return The combined size (in bytes) of all cleaned-up objects
+static size_t cleanup_helper(size_t limit)
+{
+    size_t cleaned_up = 0;
+    object_t *found_fallback[SWEEP_FALLBACK];
+    obj *payloads_fallback[SWEEP_FALLBACK];
+    while (object_list && limit > 0)
+    {
+        size_t size = ref_linked_list_size(object_list);
+        sweep_t sweep = {.capacity = limit < size ? limit : size};
+        sweep.found = malloc(sweep.capacity * sizeof(object_t *));
+        sweep.payloads = malloc(sweep.capacity * sizeof(obj *));
+        if (!sweep.found || !sweep.payloads)
+        {
+            free(sweep.found);
+            free(sweep.payloads);
+            sweep.found = found_fallback;
+            sweep.payloads = payloads_fallback;
+            sweep.capacity = sweep.capacity < SWEEP_FALLBACK ? sweep.capacity : SWEEP_FALLBACK;
+        }
 
-            return cleanup_helper(start_index, limit - 1, cleaned_up + object_size);
+        ref_linked_list_any(object_list, collect_garbage, &sweep);
+        if (sweep.count > 0)
+        {
+            cleaned_up += free_garbage(&sweep);
+            limit -= sweep.count;
         }
-        else
+        if (sweep.found != found_fallback)
+        {
+            free(sweep.found);
+            free(sweep.payloads);
+        }
+        if (object_list && ref_linked_list_size(object_list) == 0)
         {
-            return cleanup_helper(start_index + 1, limit, cleaned_up);
+            ref_linked_list_destroy(object_list);
+            object_list = NULL;
+        }
+        if (sweep.count == 0)
+        {
+            break;
         }
     }
+    return cleaned_up;
 }
 
 void cleanup(void)
 {
-    cleanup_helper(0, SIZE_MAX, 0);
+    bool locked = refmem_lock_heap();
+    refmem_record_call(REFMEM_TRACE_CLEANUP);
+    refmem_pause_begin(REFMEM_PAUSE_CLEANUP);
+    cleanup_helper(SIZE_MAX);
+    refmem_pause_end();
+    refmem_unlock_heap(locked);
 }
 
-obj *allocate(size_t bytes, function1_t destructor)
+/// @brief Get the memory for a payload and its header
+/// @param owner The struct of the object, stored in the header
+/// @param bytes The size of the payload
+/// @param alignment A power of two, or 0 for the alignment of malloc
+/// @param flags REFMEM_UNINIT to leave the memory as it is
+/// @return the payload, NULL if out of memory
+static obj *new_payload(object_t *owner, size_t bytes, size_t alignment, unsigned flags)
+{
+    size_t padding = payload_padding(alignment);
+    if (bytes > SIZE_MAX - padding)
+    {
+        return NULL;
+    }
+    char *block = flags & REFMEM_UNINIT ? malloc(padding + bytes) : calloc(1, padding + bytes);
+    if (!block)
+    {
+        return NULL;
+    }
+    char *payload = block + HEADER_SIZE;
+    if (over_aligned(alignment))
+    {
+        payload = (char *)(((uintptr_t)payload + alignment - 1) & ~(uintptr_t)(alignment - 1));
+        ((char **)payload)[-2] = block;
+    }
+    ((object_t **)payload)[-1] = owner;
+    return payload;
+}
+
+/// @brief Allocate an object, after reclaiming garbage as described for allocate
+/// @param bytes The size of the object
+/// @param alignment The alignment of the payload, a power of two, or 0 for
+///        the alignment of malloc
+/// @param destructor The destructor of the object, NULL for the default destructor
+/// @param scan_size The number of bytes at the start that may hold pointers
+/// @param flags REFMEM_OWNED and REFMEM_UNINIT, or 0
+/// @param site The call site to account the allocation to, or NULL
+/// @return A pointer to the allocated space for the object
+static obj *allocate_scanned(size_t bytes, size_t alignment, function1_t destructor,
+                             size_t scan_size, unsigned flags, refmem_site_t *site)
 {
+    /* Sizes that cannot be allocated fail before any garbage is reclaimed */
+    if (alignment & (alignment - 1) || bytes > SIZE_MAX - payload_padding(alignment))
+    {
+        return NULL;
+    }
+    bool locked = refmem_lock_heap();
+    /* Releases from other threads, and those that readers no longer hold
+       back, may free memory for this allocation. Done under the heap lock,
+       since a destructor on the collector thread may allocate too. */
+    refmem_drain_remote();
+    refmem_epoch_reclaim();
+    refmem_record_from_env();
+    uint64_t trace_number = refmem_record_allocate(bytes);
+
     /* ON first allocation, create the list. */
     if (!object_list)
     {
@@ -246,73 +832,576 @@ obj *allocate(size_t bytes, function1_t destructor)
 
     size_t total_freed_memory = 0;
     size_t new_freed_memory;
-    do
+    /* Objects must not be freed under shutdown() while it walks object_list */
+    if (!shutting_down)
     {
-        new_freed_memory = cleanup_helper(0, cascade_limit, total_freed_memory);
-        total_freed_memory += new_freed_memory;
-    } while (new_freed_memory != 0 && total_freed_memory < bytes);
+        refmem_pause_begin(REFMEM_PAUSE_ALLOCATE);
+        do
+        {
+            new_freed_memory = cleanup_helper(cascade_limit);
+            total_freed_memory += new_freed_memory;
+        } while (new_freed_memory != 0 && total_freed_memory < bytes);
+        refmem_pause_end();
+    }
 
     if (!object_list)
     {
         object_list = ref_linked_list_create(NULL);
     }
 
-    object_t *result = calloc(1, sizeof(object_t));
+    object_t *result = new_struct();
     // add_ptr_to_memory(result);
+    obj *payload = result ? new_payload(result, bytes, alignment, flags) : NULL;
+    if (result && !payload)
+    {
+        free_struct(result);
+        result = NULL;
+    }
 
     /* Check if allocation went well, result is NULL if it did not */
     if (result)
     {
-        result->object = calloc(1, bytes);
+        result->object = payload;
         add_ptr_to_memory(result->object);
-        result->rc = 0;
+        result->rc = flags & REFMEM_OWNED ? 1 : 0;
+        result->scan_size = flags & REFMEM_UNINIT ? 0 : scan_size;
+        result->uninit = flags & REFMEM_UNINIT;
         result->destructor = destructor;
         result->size = bytes;
+        result->alignment = alignment;
+        result->site = site;
+        result->sample = refmem_sample_allocation(bytes);
+        if (site)
+        {
+            refmem_site_note_allocate(site, bytes);
+        }
         ref_linked_list_append(object_list, (ref_elem_t){.p = (result)});
+        refmem_record_allocated(result->object, trace_number);
+        REFMEM_HOOK(on_allocate, result->object, bytes);
+        if (flags & REFMEM_OWNED)
+        {
+            /* Traces and hooks see the reference taken as a retain */
+            refmem_record_object(REFMEM_TRACE_RETAIN, result->object);
+            REFMEM_HOOK(on_retain, result->object, 1);
+        }
+        refmem_unlock_heap(locked);
         return result->object;
     }
     else
+    {
+        refmem_unlock_heap(locked);
+        return NULL;
+    }
+}
+
+/// @brief Allocate an object, see allocate_ex
+/// @param site The call site to account the allocation to, or NULL
+static obj *allocate_object(size_t bytes, function1_t destructor, unsigned flags, size_t alignment,
+                            size_t trailer, refmem_site_t *site)
+{
+    if (bytes > SIZE_MAX - trailer)
     {
         return NULL;
     }
+    /* The bytes are scanned for pointers, the trailer only when asked to */
+    size_t scan_size = flags & REFMEM_SCAN_TRAILER ? bytes + trailer : bytes;
+    return allocate_scanned(bytes + trailer, alignment, destructor, scan_size,
+                            flags & (REFMEM_OWNED | REFMEM_UNINIT), site);
+}
+
+obj *allocate_ex(size_t bytes, function1_t destructor, unsigned flags, size_t alignment,
+                 size_t trailer)
+{
+    return allocate_object(bytes, destructor, flags, alignment, trailer, NULL);
+}
+
+obj *allocate_ex_at(size_t bytes, function1_t destructor, unsigned flags, size_t alignment,
+                    size_t trailer, const char *file, int line, const char *func)
+{
+    return allocate_object(bytes, destructor, flags, alignment, trailer,
+                           refmem_site_get(file, line, func));
+}
+
+obj *allocate(size_t bytes, function1_t destructor)
+{
+    return allocate_object(bytes, destructor, 0, 0, 0, NULL);
 }
 
 obj *allocate_array(size_t elements, size_t elem_size, function1_t destructor)
 {
-    /* ON first allocation, create the list. */
-    if (!object_list)
+    return allocate_object(refmem_array_size(elements, elem_size), destructor, 0, 0, 0, NULL);
+}
+
+obj *allocate_owned(size_t bytes, function1_t destructor)
+{
+    return allocate_object(bytes, destructor, REFMEM_OWNED, 0, 0, NULL);
+}
+
+obj *allocate_array_owned(size_t elements, size_t elem_size, function1_t destructor)
+{
+    return allocate_object(refmem_array_size(elements, elem_size), destructor, REFMEM_OWNED, 0, 0,
+                           NULL);
+}
+
+obj *allocate_uninit(size_t bytes, function1_t destructor)
+{
+    return allocate_object(bytes, destructor, REFMEM_UNINIT, 0, 0, NULL);
+}
+
+obj *allocate_array_uninit(size_t elements, size_t elem_size, function1_t destructor)
+{
+    return allocate_object(refmem_array_size(elements, elem_size), destructor, REFMEM_UNINIT, 0, 0,
+                           NULL);
+}
+
+obj *allocate_aligned(size_t bytes, size_t alignment, function1_t destructor)
+{
+    return allocate_object(bytes, destructor, 0, alignment, 0, NULL);
+}
+
+obj *allocate_array_aligned(size_t elements, size_t elem_size, size_t alignment,
+                            function1_t destructor)
+{
+    return allocate_object(refmem_array_size(elements, elem_size), destructor, 0, alignment, 0,
+                           NULL);
+}
+
+obj *allocate_with_trailer(size_t header_size, size_t elem_count, size_t elem_size,
+                           function1_t destructor)
+{
+    if (elem_size && elem_count > SIZE_MAX / elem_size)
     {
-        object_list = ref_linked_list_create(NULL);
+        return NULL;
     }
+    return allocate_object(header_size, destructor, 0, 0, elem_count * elem_size, NULL);
+}
 
-    /* If the required allocation size is larger than
-       SIZE_MAX, the allocation is not possible, so return NULL */
-    return elem_size == 0 || (elements < SIZE_MAX / elem_size)
-               ? allocate(elements * elem_size, destructor)
-               : NULL;
+void refmem_move(obj **dst, obj **src)
+{
+    if (dst == src)
+    {
+        return;
+    }
+    obj *previous = *dst;
+    *dst = *src;
+    *src = NULL;
+    release(previous);
 }
 
-void deallocate(obj *object)
+obj *reallocate(obj *object, size_t bytes)
 {
-    /* Get object and index from list */
-    int to_deallocate_index;
-    object_t *to_deallocate = get_struct(object);
+    if (shutting_down)
+    {
+        return NULL;
+    }
+    bool locked = refmem_lock_heap();
+    object_t *object_struct = find_object(object, "reallocate");
+    obj *resized = NULL;
+    /* An object waiting for the collector is garbage and is not resized */
+    if (object_struct && !object_struct->free_pending)
+    {
+        if (over_aligned(object_struct->alignment))
+        {
+            /* realloc would not keep the alignment */
+            resized = new_payload(object_struct, bytes, object_struct->alignment, REFMEM_UNINIT);
+            if (resized)
+            {
+                memcpy(resized, object, bytes < object_struct->size ? bytes : object_struct->size);
+                free_payload(object_struct);
+            }
+        }
+        else if (bytes <= SIZE_MAX - HEADER_SIZE)
+        {
+            /* The header moves along with the payload */
+            char *block = realloc((char *)object - HEADER_SIZE, HEADER_SIZE + bytes);
+            resized = block ? block + HEADER_SIZE : NULL;
+        }
+    }
+    if (resized)
+    {
+        size_t old_size = object_struct->size;
+        if (bytes > old_size && !object_struct->uninit)
+        {
+            /* Zeroed like the rest of the payload, for the default destructor */
+            memset((char *)resized + old_size, 0, bytes - old_size);
+        }
+        /* A payload scanned in full stays so, a shorter scanned part stays as
+           it is unless it is cut off */
+        if (object_struct->scan_size == old_size || object_struct->scan_size > bytes)
+        {
+            object_struct->scan_size = object_struct->uninit ? 0 : bytes;
+        }
+        if (resized != object)
+        {
+            move_ptr_in_memory(object, resized);
+        }
+        refmem_record_reallocate(object, resized, bytes);
+        if (object_struct->site)
+        {
+            refmem_site_note_resize(object_struct->site, old_size, bytes);
+        }
+        object_struct->object = resized;
+        object_struct->size = bytes;
+        REFMEM_HOOK(on_reallocate, object, resized, old_size, bytes);
+    }
+    refmem_unlock_heap(locked);
+    return resized;
+}
 
+/// @brief Deallocate an object whose struct is known, see deallocate
+/// @param to_deallocate the struct of the object, or NULL
+static void deallocate_struct(object_t *to_deallocate)
+{
     /* If the object exists and rc is 0 then remove it from list and start deallocating it */
-    if (to_deallocate && get_struct_index(object, &to_deallocate_index) && to_deallocate->rc == 0)
+    /* An object with releases queued by other threads stays in their queue
+       until the owner drains it */
+    if (to_deallocate && to_deallocate->rc == 0 && !to_deallocate->free_pending &&
+        !to_deallocate->immortal && atomic_load(&to_deallocate->remote_releases) == 0)
     {
-        if (freed_objects < cascade_limit)
+        if (refmem_collector_running() && refmem_collector_enqueue(to_deallocate))
+        {
+            /* The collector thread frees it */
+            to_deallocate->free_pending = true;
+        }
+        else if (freed_objects < cascade_limit)
         {
+            refmem_pause_begin(REFMEM_PAUSE_CASCADE);
             freed_objects++;
             destroy_object(to_deallocate);
-            ref_linked_list_remove(object_list, to_deallocate_index);
+            refmem_pause_end();
         }
     }
     freed_objects = 0;
 }
 
+void deallocate(obj *object)
+{
+    if (shutting_down)
+    {
+        return;
+    }
+    bool locked = refmem_lock_heap();
+    refmem_record_object(REFMEM_TRACE_DEALLOCATE, object);
+    deallocate_struct(find_object(object, "deallocate"));
+    refmem_unlock_heap(locked);
+}
+
+typedef struct batch batch_t;
+struct batch
+{
+    /// @brief The objects, sorted by address and without NULL
+    obj **objects;
+    size_t count;
+    /// @brief The number of distinct objects not yet found in object_list
+    size_t remaining;
+    bool retain;
+    /// @brief The structs whose reference count release_many dropped to 0
+    object_t **dropped;
+    size_t dropped_count;
+};
+
+#ifndef REFMEM_FAST
+/// @brief Sort the objects of a batch and count the distinct ones
+/// @return false if there is no memory for the sorted copy
+static bool prepare_batch(batch_t *batch, obj **objects, size_t count)
+{
+    batch->objects = malloc(count * sizeof(obj *));
+    if (!batch->objects)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (objects[i])
+        {
+            batch->objects[batch->count++] = objects[i];
+        }
+    }
+    qsort(batch->objects, batch->count, sizeof(obj *), compare_pointers);
+    for (size_t i = 0; i < batch->count; i++)
+    {
+        if (i == 0 || batch->objects[i] != batch->objects[i - 1])
+        {
+            batch->remaining++;
+        }
+    }
+    return true;
+}
+
+#endif
+
+/// @brief Retain or release one object of a batch a number of times
+/// @param batch the batch
+/// @param object_struct the struct of the object
+/// @param times the number of times the object occurs in the batch
+static void apply_struct(batch_t *batch, object_t *object_struct, size_t times)
+{
+    if (object_struct->immortal)
+    {
+        return;
+    }
+    for (size_t i = 0; i < times; i++)
+    {
+        if (batch->retain)
+        {
+            object_struct->rc++;
+            REFMEM_HOOK(on_retain, object_struct->object, object_struct->rc);
+        }
+        else
+        {
+            if (object_struct->rc > 0)
+            {
+                object_struct->rc--;
+            }
+            REFMEM_HOOK(on_release, object_struct->object, object_struct->rc);
+        }
+    }
+    /* Marked, so that the destructors of objects freed before it do not free
+       it through release or deallocate, and so that it is dropped once */
+    if (!batch->retain && object_struct->rc == 0 && !object_struct->free_pending)
+    {
+        object_struct->free_pending = true;
+        batch->dropped[batch->dropped_count++] = object_struct;
+    }
+}
+
+#ifndef REFMEM_FAST
+/// @brief Apply every retain or release of the batch that refers to one
+///        struct. Stops the walk of object_list once every object is found.
+static bool apply_batch(ref_list_t *list, ref_elem_t value, void *extra)
+{
+    batch_t *batch = extra;
+    object_t *object_struct = value.p;
+    obj *object = object_struct->object;
+
+    size_t low = 0;
+    size_t high = batch->count;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        if ((uintptr_t)batch->objects[middle] < (uintptr_t)object)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    if (low == batch->count || batch->objects[low] != object)
+    {
+        return false;
+    }
+
+    size_t end = low;
+    while (end < batch->count && batch->objects[end] == object)
+    {
+        end++;
+    }
+    apply_struct(batch, object_struct, end - low);
+    return --batch->remaining == 0;
+}
+#endif
+
+/// @brief Free the objects that release_many dropped to reference count 0, at
+///        most cascade_limit of them. The rest stay garbage for a later sweep.
+///        Unless refmem is built with REFMEM_FAST they were found in the order
+///        of object_list, so every object freed is the oldest one left of
+///        them, which keeps the walks of object_list and ptr_list that freeing
+///        does short.
+static void free_batch(batch_t *batch)
+{
+    size_t budget = batch->dropped_count < cascade_limit ? batch->dropped_count : cascade_limit;
+
+    refmem_pause_begin(REFMEM_PAUSE_CASCADE);
+    for (size_t i = 0; i < batch->dropped_count; i++)
+    {
+        object_t *object_struct = batch->dropped[i];
+        object_struct->free_pending = false;
+        /* Not freed if a destructor run before retained it again */
+        if (i < budget)
+        {
+            deallocate_struct(object_struct);
+        }
+    }
+    refmem_pause_end();
+}
+
+/// @brief Get the memory a batch needs. REFMEM_FAST builds read every
+///        struct from its object's header and need no sorted copy.
+/// @return false if there is not enough memory
+static bool start_batch(batch_t *batch, obj **objects, size_t count)
+{
+#ifndef REFMEM_FAST
+    if (!prepare_batch(batch, objects, count))
+    {
+        return false;
+    }
+#endif
+    return batch->retain || (batch->dropped = malloc(count * sizeof(object_t *)));
+}
+
+/// @brief Retain or release a number of objects, see retain_many and
+///        release_many
+static void apply_many(obj **objects, size_t count, bool retain_objects)
+{
+    if (shutting_down || count == 0)
+    {
+        return;
+    }
+    bool locked = refmem_lock_heap();
+#ifdef REFMEM_CHECKED
+    /* Every pointer is checked before any count is changed */
+    for (size_t i = 0; i < count; i++)
+    {
+        find_object(objects[i], retain_objects ? "retain_many" : "release_many");
+    }
+#endif
+    batch_t batch = {.retain = retain_objects};
+    if (!start_batch(&batch, objects, count))
+    {
+        /* Without memory to sort in, they are done one at a time */
+        free(batch.objects);
+        for (size_t i = 0; i < count; i++)
+        {
+            if (retain_objects)
+            {
+                retain(objects[i]);
+            }
+            else
+            {
+                release(objects[i]);
+            }
+        }
+        refmem_unlock_heap(locked);
+        return;
+    }
+
+    /* Recorded as one call, which the replay makes as one as well */
+    refmem_record_many(retain_objects ? REFMEM_TRACE_RETAIN_MANY : REFMEM_TRACE_RELEASE_MANY,
+                       objects, count);
+#ifdef REFMEM_FAST
+    for (size_t i = 0; i < count; i++)
+    {
+        object_t *object_struct =
+            find_object(objects[i], retain_objects ? "retain_many" : "release_many");
+        if (object_struct)
+        {
+            apply_struct(&batch, object_struct, 1);
+        }
+    }
+#else
+    if (batch.remaining > 0 && object_list)
+    {
+        ref_linked_list_any(object_list, apply_batch, &batch);
+    }
+#endif
+    if (!retain_objects)
+    {
+        free_batch(&batch);
+        if (object_list != NULL && ref_linked_list_size(object_list) == 0)
+        {
+            ref_linked_list_destroy(object_list);
+            object_list = NULL;
+        }
+    }
+    free(batch.objects);
+    free(batch.dropped);
+    refmem_unlock_heap(locked);
+}
+
+void retain_many(obj **objects, size_t count)
+{
+    apply_many(objects, count, true);
+}
+
+void release_many(obj **objects, size_t count)
+{
+    apply_many(objects, count, false);
+}
+
+void refmem_collect(object_t *object_struct)
+{
+    bool locked = refmem_lock_heap();
+    if (object_struct->rc != 0)
+    {
+        /* Retained again while it waited in the queue */
+        object_struct->free_pending = false;
+        refmem_unlock_heap(locked);
+        return;
+    }
+
+    /* The destructor runs without the heap lock, so that retain and release
+       on the owner's thread do not wait for it. Each refmem call it makes
+       takes the lock itself, and free_pending stays set so that neither a
+       sweep nor deallocate frees the object in the meantime. A recording
+       keeps the lock, since the calls of the destructor must not be mixed
+       with the owner's in the trace. */
+    remove_ptr_from_memory(object_struct->object);
+    if (refmem_recording())
+    {
+        run_object_destructor(object_struct);
+    }
+    else
+    {
+        refmem_unlock_heap(locked);
+        object_struct->destructor(object_struct->object);
+        locked = refmem_lock_heap();
+    }
+    free_destroyed(object_struct);
+    if (ref_linked_list_size(object_list) == 0)
+    {
+        ref_linked_list_destroy(object_list);
+        object_list = NULL;
+    }
+    refmem_unlock_heap(locked);
+}
+
+typedef struct for_each_context for_each_context_t;
+struct for_each_context
+{
+    void (*fun)(object_t *object_struct, void *extra);
+    void *extra;
+};
+
+static void for_each_apply(ref_elem_t *value, void *extra)
+{
+    for_each_context_t *context = extra;
+    object_t *object_struct = value->p;
+    /* Objects a sweep has freed are skipped until it unlinks them */
+    if (object_struct->object)
+    {
+        context->fun(object_struct, context->extra);
+    }
+}
+
+void refmem_for_each_object(void (*fun)(object_t *object_struct, void *extra), void *extra)
+{
+    bool locked = refmem_lock_heap();
+    if (object_list)
+    {
+        for_each_context_t context = {.fun = fun, .extra = extra};
+        ref_linked_list_apply_to_all(object_list, for_each_apply, &context);
+    }
+    refmem_unlock_heap(locked);
+}
+
+function1_t refmem_get_default_destructor(void)
+{
+    return default_destructor;
+}
+
+size_t refmem_object_count(void)
+{
+    bool locked = refmem_lock_heap();
+    size_t count = object_list ? ref_linked_list_size(object_list) - dead_structs : 0;
+    refmem_unlock_heap(locked);
+    return count;
+}
+
 void set_cascade_limit(size_t limit)
 {
+    refmem_record_cascade_limit(limit);
     cascade_limit = limit;
 }
 
@@ -321,18 +1410,180 @@ size_t get_cascade_limit(void)
     return cascade_limit;
 }
 
+static void freeze_object(ref_elem_t *value, void *extra)
+{
+    object_t *object_struct = value->p;
+    if (object_struct->object && !object_struct->immortal)
+    {
+        object_struct->immortal = true;
+        (*(size_t *)extra)++;
+    }
+}
+
+size_t refmem_freeze(void)
+{
+    bool locked = refmem_lock_heap();
+    refmem_record_call(REFMEM_TRACE_FREEZE);
+    size_t frozen = 0;
+    if (object_list)
+    {
+        ref_linked_list_apply_to_all(object_list, freeze_object, &frozen);
+    }
+    refmem_unlock_heap(locked);
+    return frozen;
+}
+
+void set_shutdown_destructors(bool run)
+{
+    shutdown_destructors = run;
+}
+
+bool get_shutdown_destructors(void)
+{
+    return shutdown_destructors;
+}
+
+void set_shutdown_threads(size_t threads)
+{
+    shutdown_threads = threads > 0 ? threads : 1;
+}
+
+size_t get_shutdown_threads(void)
+{
+    return shutdown_threads;
+}
+
+static void run_destructor(ref_elem_t *value, void *extra)
+{
+    object_t *object_struct = value->p;
+    /* The default destructor only releases, which is pointless here */
+    if (object_struct->destructor != default_destructor)
+    {
+        object_struct->destructor(object_struct->object);
+    }
+}
+
+static void free_object(ref_elem_t *value, void *extra)
+{
+    object_t *object_struct = value->p;
+    note_free(object_struct);
+    free_payload(object_struct);
+}
+
+// The fewest objects a thread is started for by a parallel shutdown
+#define SHUTDOWN_MIN_CHUNK 4096
+
+typedef struct free_chunk free_chunk_t;
+struct free_chunk
+{
+    object_t **objects;
+    size_t count;
+};
+
+/// @brief Free the payloads of a chunk of objects, run on a thread of its own
+/// @param extra the free_chunk_t to free
+static void *free_chunk(void *extra)
+{
+    free_chunk_t *chunk = extra;
+    for (size_t i = 0; i < chunk->count; i++)
+    {
+        free_payload(chunk->objects[i]);
+    }
+    return NULL;
+}
+
+static void collect_object(ref_elem_t *value, void *extra)
+{
+    object_t ***next = extra;
+    /* The accounting is not thread safe, so it is done while collecting */
+    note_free(value->p);
+    *(*next)++ = value->p;
+}
+
+/// @brief Free every object in object_list, split into chunks over up to
+///        shutdown_threads threads
+/// @return false if nothing was freed, since the heap is too small to split
+///         or the chunks could not be allocated
+static bool free_objects_in_parallel(void)
+{
+    size_t count = ref_linked_list_size(object_list);
+    size_t threads = shutdown_threads;
+    if (threads > count / SHUTDOWN_MIN_CHUNK)
+    {
+        threads = count / SHUTDOWN_MIN_CHUNK;
+    }
+    if (threads < 2)
+    {
+        return false;
+    }
+
+    object_t **objects = malloc(count * sizeof(object_t *));
+    free_chunk_t *chunks = malloc(threads * sizeof(free_chunk_t));
+    pthread_t *ids = malloc(threads * sizeof(pthread_t));
+    if (!objects || !chunks || !ids)
+    {
+        free(objects);
+        free(chunks);
+        free(ids);
+        return false;
+    }
+    object_t **next = objects;
+    ref_linked_list_apply_to_all(object_list, collect_object, &next);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        chunks[i].objects = objects + count * i / threads;
+        chunks[i].count = count * (i + 1) / threads - count * i / threads;
+    }
+    /* The calling thread frees the first chunk, and any chunk that no
+       thread could be started for */
+    for (size_t i = 1; i < threads; i++)
+    {
+        if (pthread_create(&ids[i], NULL, free_chunk, &chunks[i]) != 0)
+        {
+            free_chunk(&chunks[i]);
+            chunks[i].objects = NULL;
+        }
+    }
+    free_chunk(&chunks[0]);
+    for (size_t i = 1; i < threads; i++)
+    {
+        if (chunks[i].objects)
+        {
+            pthread_join(ids[i], NULL);
+        }
+    }
+
+    free(objects);
+    free(chunks);
+    free(ids);
+    return true;
+}
+
 void shutdown(void)
 {
+    /* The collector frees what it has queued before it stops */
+    refmem_collector_stop();
+    refmem_remote_discard();
+    refmem_epoch_discard();
+    refmem_record_call(REFMEM_TRACE_SHUTDOWN);
+    refmem_pause_begin(REFMEM_PAUSE_SHUTDOWN);
     if (object_list != NULL)
     {
-        while (ref_linked_list_size(object_list) > 0)
+        /* Every object goes, so nothing is looked up or removed one by one:
+           the destructors run in one pass, the payloads are freed in a
+           second and the lists and object structs are dropped whole */
+        if (shutdown_destructors)
+        {
+            shutting_down = true;
+            refmem_slow_paths |= REFMEM_SLOW_SHUTDOWN;
+            ref_linked_list_apply_to_all(object_list, run_destructor, NULL);
+            refmem_slow_paths &= ~REFMEM_SLOW_SHUTDOWN;
+            shutting_down = false;
+        }
+        if (shutdown_threads < 2 || !free_objects_in_parallel())
         {
-            ref_elem_t object = ref_linked_list_get(object_list, 0);
-            struct object *obj_struct = (struct object *)object.p;
-            ref_linked_list_remove(object_list, 0);
-            remove_ptr_from_memory(obj_struct->object);
-            free(obj_struct->object);
-            free(obj_struct);
+            ref_linked_list_apply_to_all(object_list, free_object, NULL);
         }
         ref_linked_list_destroy(object_list);
         object_list = NULL;
@@ -341,4 +1592,8 @@ void shutdown(void)
         ref_linked_list_destroy(ptr_list);
         ptr_list = NULL;
     }
+    free_all_structs();
+    empty_quarantine();
+    refmem_pause_end();
+    refmem_pause_shutdown_dump();
 }
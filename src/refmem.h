@@ -1,10 +1,16 @@
 #include <stddef.h>
+#include <stdint.h>
 #include "linked_list.h"
 #pragma once
 
 typedef void obj;
 typedef void (*function1_t)(obj *);
 
+// retain, release, rc, deallocate and reallocate ignore pointers that are not
+// objects, such as pointers into an object. Builds with REFMEM_CHECKED stop
+// the program on a pointer that is neither NULL nor a live object, and builds
+// with REFMEM_FAST take every pointer but NULL to be an object.
+
 /// @brief Increases refrence count by 1. Does nothing when called on NULL
 /// @param object the object to operate on
 void retain(obj *object);
@@ -15,6 +21,22 @@ void retain(obj *object);
 /// @param object the object to operate on
 void release(obj *object);
 
+/// @brief Retain every object in an array, as retain would one at a time.
+///        NULL elements are skipped and an object may occur more than once.
+/// @param objects the objects to operate on
+/// @param count the number of elements in objects
+void retain_many(obj **objects, size_t count);
+
+/// @brief Release every object in an array, as release would one at a time.
+///        The objects are looked up in one walk of the heap and those whose
+///        reference count drops to 0 are freed together afterwards, oldest
+///        first. REFMEM_FAST builds read each object's header instead and
+///        free them in the order they are given. At most the cascade limit of
+///        them are freed, the rest are left for a later allocate or cleanup.
+/// @param objects the objects to operate on
+/// @param count the number of elements in objects
+void release_many(obj **objects, size_t count);
+
 /// @brief Will return the amount of references an object has. 
 ///        Example: object A points towards object B, but object A has no other references, then the
 ///        reference count of object B will be 1, and the reference count of object A will be 0.
@@ -36,6 +58,155 @@ obj *allocate(size_t bytes, function1_t destructor);
 /// is greater than the cascade limit
 obj *allocate_array(size_t elements, size_t elem_size, function1_t destructor);
 
+/// @brief Like allocate, but the object is returned with reference count 1
+/// (see REFMEM_OWNED)
+/// @param bytes The size of the object that we want to allocate space for
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object
+obj *allocate_owned(size_t bytes, function1_t destructor);
+
+/// @brief Like allocate_array, but the object is returned with reference
+/// count 1 (see REFMEM_OWNED)
+/// @param elements The number of elements that we want to allocate space for
+/// @param elem_size The size of the object that we want to allocate space for
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object or NULL if the
+/// required allocation size is greater than SIZE_MAX
+obj *allocate_array_owned(size_t elements, size_t elem_size, function1_t destructor);
+
+/// @brief Like allocate, but the payload is not zeroed (see REFMEM_UNINIT)
+/// @param bytes The size of the object that we want to allocate space for
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object
+obj *allocate_uninit(size_t bytes, function1_t destructor);
+
+/// @brief Like allocate_array, but the payload is not zeroed (see
+/// REFMEM_UNINIT)
+/// @param elements The number of elements that we want to allocate space for
+/// @param elem_size The size of the object that we want to allocate space for
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object or NULL if the
+/// required allocation size is greater than SIZE_MAX
+obj *allocate_array_uninit(size_t elements, size_t elem_size, function1_t destructor);
+
+/// @brief Like allocate, but the payload is aligned to the given number of
+/// bytes (see the alignment of allocate_ex)
+/// @param bytes The size of the object that we want to allocate space for
+/// @param alignment The alignment of the object, a power of two
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object, or NULL if the
+/// alignment is not a power of two
+obj *allocate_aligned(size_t bytes, size_t alignment, function1_t destructor);
+
+/// @brief Like allocate_array, but the payload is aligned (see
+/// allocate_aligned)
+/// @param elements The number of elements that we want to allocate space for
+/// @param elem_size The size of the object that we want to allocate space for
+/// @param alignment The alignment of the object, a power of two
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object or NULL if the
+/// alignment is not a power of two or the required allocation size is greater
+/// than SIZE_MAX
+obj *allocate_array_aligned(size_t elements, size_t elem_size, size_t alignment,
+                            function1_t destructor);
+
+/// @brief Allocates a struct followed by a tail of elem_count elements in one
+/// object (see the trailer of allocate_ex). The tail starts header_size bytes
+/// in, which is where a flexible array member of a struct of that size fits.
+/// @param header_size The size of the struct at the start of the object
+/// @param elem_count The number of elements in the tail
+/// @param elem_size The size of each element of the tail
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @return A pointer to the allocated space for the object or NULL if the
+/// required allocation size is greater than SIZE_MAX
+obj *allocate_with_trailer(size_t header_size, size_t elem_count, size_t elem_size,
+                           function1_t destructor);
+
+/// @brief Options of allocate_ex, combined with |
+enum refmem_allocate_flags
+{
+    /// @brief The object is returned with reference count 1, owned by the
+    /// caller, so that no retain is needed and the object is never garbage
+    /// before the caller has stored it
+    REFMEM_OWNED = 1,
+    /// @brief The payload is not zeroed, which saves the time to clear it when
+    /// the caller writes all of it anyway. Since it may hold anything, the
+    /// default destructor and heap dumps never look for pointers in it: an
+    /// object that holds references must be given a destructor that releases
+    /// them.
+    REFMEM_UNINIT = 2,
+    /// @brief The trailer holds references like the rest of the object: the
+    /// default destructor releases the objects it points to and heap dumps
+    /// show them as edges. The trailer must then be zeroed or hold only
+    /// pointers and other data that is never mistaken for one.
+    REFMEM_SCAN_TRAILER = 4,
+};
+
+/// @brief Allocates an object with the given options, of which allocate and
+/// the other allocate functions are shorthands.
+/// @param bytes The size of the object that we want to allocate space for,
+/// not counting the trailer. For an array, see refmem_array_size.
+/// @param destructor A function used to deallocate smaller segments of an object, can also be null
+/// @param flags REFMEM_OWNED, REFMEM_UNINIT and REFMEM_SCAN_TRAILER, or 0
+/// @param alignment The alignment of the payload, a power of two, e.g. 64 for
+/// AVX-512 loads or the page size, or 0 for that of malloc. One larger than
+/// malloc's alignment costs up to that many bytes of padding in front of the
+/// payload. reallocate keeps the alignment.
+/// @param trailer The number of bytes that follow the first `bytes` in the
+/// same object, e.g. for the strings a record holds, so that they need no
+/// object and no reference counting of their own. The trailer is where a
+/// flexible array member of a struct of `bytes` bytes fits. Pointers in the
+/// first `bytes` are found by the default destructor and heap dumps as usual.
+/// The trailer is only scanned with REFMEM_SCAN_TRAILER, since it usually
+/// holds characters or numbers, and scanning those would take any value that
+/// happens to equal an object's address for a reference to it. Without the
+/// flag, references kept in it must be released by the destructor. Pointers
+/// into the trailer are not objects.
+/// @return A pointer to the allocated space for the object, or NULL if the
+/// alignment is not a power of two or the size is greater than SIZE_MAX
+obj *allocate_ex(size_t bytes, function1_t destructor, unsigned flags, size_t alignment,
+                 size_t trailer);
+
+/// @brief Like allocate_ex, but records the call site for the statistics in
+/// refmem_sites.h. Usually called through the macros that replace the
+/// allocate functions when REFMEM_TRACK_SITES is defined.
+/// @param file The file of the call site
+/// @param line The line of the call site
+/// @param func The function containing the call site
+obj *allocate_ex_at(size_t bytes, function1_t destructor, unsigned flags, size_t alignment,
+                    size_t trailer, const char *file, int line, const char *func);
+
+/// @brief The size of an array, for allocate_ex
+/// @param elements The number of elements
+/// @param elem_size The size of each element
+/// @return elements * elem_size, or SIZE_MAX if that does not fit, which no
+/// allocation succeeds with
+static inline size_t refmem_array_size(size_t elements, size_t elem_size)
+{
+    return elem_size && elements > SIZE_MAX / elem_size ? SIZE_MAX : elements * elem_size;
+}
+
+/// @brief Resizes an object, keeping its reference count, destructor and the
+/// rest of its bookkeeping. The object is grown or shrunk in place when the
+/// allocator can, and moved otherwise, like realloc. Other objects that
+/// point to it must then be updated by the caller, and it must not be resized
+/// while a release of it is queued by refmem_release_remote or
+/// refmem_epoch_release. Added bytes are zeroed,
+/// unless the object was allocated with REFMEM_UNINIT.
+/// @param object The object to resize
+/// @param bytes The new size of the object
+/// @return The address of the resized object, or NULL if object is not an
+/// allocated object or there is not enough memory, in which case it is left
+/// as it was
+obj *reallocate(obj *object, size_t bytes);
+
+/// @brief Moves the reference held in *src to *dst without changing its
+/// reference count. *src is set to NULL, and the reference that *dst held
+/// before is released.
+/// @param dst Where the reference goes
+/// @param src Where the reference comes from
+void refmem_move(obj **dst, obj **src);
+
 /// @brief If the objects reference count is 0 this function will deallocate all memory related to the object
 ///        If the object could not be 
 /// @param obj The object which we want to deallocate
@@ -54,5 +225,57 @@ size_t get_cascade_limit(void);
 /*Free all objects with reference count 0*/
 void cleanup(void);
 
+/// @brief Make every object allocated so far immortal: retain and release no
+/// longer change its reference count, and it is only freed by shutdown. A
+/// program that builds a heap and then forks can freeze it first, so that the
+/// children do not write to, and copy, the pages the objects are on.
+/// @return The number of objects that were frozen
+size_t refmem_freeze(void);
+
+/// @brief Sets whether shutdown runs the destructors of the objects it frees.
+/// Off by default. When on, every destructor other than the default one runs
+/// once, before any object is freed, so a destructor may still read the
+/// objects it points to. retain, release and deallocate do nothing while the
+/// destructors run.
+/// @param run true to run destructors on shutdown
+void set_shutdown_destructors(bool run);
+
+/// @brief Get whether shutdown runs destructors
+/// @return true if shutdown runs destructors
+bool get_shutdown_destructors(void);
+
+/// @brief Sets the number of threads shutdown frees objects on. Large heaps
+/// are split into chunks that are freed in parallel, small ones are always
+/// freed on the calling thread. Destructors run on the calling thread.
+/// @param threads The number of threads, including the calling one. 0 is
+/// taken as 1, the default.
+void set_shutdown_threads(size_t threads);
+
+/// @brief Get the number of threads shutdown frees objects on
+/// @return The number of threads
+size_t get_shutdown_threads(void);
+
 /// @brief Free's all allocated objects in the program
 void shutdown(void);
+
+#ifdef REFMEM_TRACK_SITES
+#define allocate_ex(bytes, destructor, flags, alignment, trailer) \
+    allocate_ex_at((bytes), (destructor), (flags), (alignment), (trailer), __FILE__, __LINE__, \
+                   __func__)
+#define allocate(bytes, destructor) allocate_ex((bytes), (destructor), 0, 0, 0)
+#define allocate_array(elements, elem_size, destructor) \
+    allocate_ex(refmem_array_size((elements), (elem_size)), (destructor), 0, 0, 0)
+#define allocate_owned(bytes, destructor) allocate_ex((bytes), (destructor), REFMEM_OWNED, 0, 0)
+#define allocate_array_owned(elements, elem_size, destructor) \
+    allocate_ex(refmem_array_size((elements), (elem_size)), (destructor), REFMEM_OWNED, 0, 0)
+#define allocate_uninit(bytes, destructor) allocate_ex((bytes), (destructor), REFMEM_UNINIT, 0, 0)
+#define allocate_array_uninit(elements, elem_size, destructor) \
+    allocate_ex(refmem_array_size((elements), (elem_size)), (destructor), REFMEM_UNINIT, 0, 0)
+#define allocate_aligned(bytes, alignment, destructor) \
+    allocate_ex((bytes), (destructor), 0, (alignment), 0)
+#define allocate_array_aligned(elements, elem_size, alignment, destructor) \
+    allocate_ex(refmem_array_size((elements), (elem_size)), (destructor), 0, (alignment), 0)
+#define allocate_with_trailer(header_size, elem_count, elem_size, destructor) \
+    allocate_ex((header_size), (destructor), 0, 0, \
+                refmem_array_size((elem_count), (elem_size)))
+#endif
@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <unistd.h>
+#include "refmem_chrome_trace.h"
+#include "refmem_hooks.h"
+#include "refmem_internal.h"
+
+typedef struct trace trace_t;
+struct trace
+{
+    FILE *out;
+    long pid;
+    /// @brief Whether an event has been written, so the next needs a comma
+    bool started;
+    size_t live_objects;
+    size_t live_bytes;
+};
+
+static trace_t trace;
+
+/// @brief Start an event with the fields every event has. Timestamps are in
+///        microseconds, with nanosecond precision.
+static void begin_event(const char *name, char phase, uint64_t ts_ns)
+{
+    fprintf(trace.out, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"pid\":%ld,\"tid\":1,\"ts\":%llu.%03u",
+            trace.started ? "," : "", name, phase, trace.pid,
+            (unsigned long long)(ts_ns / 1000), (unsigned)(ts_ns % 1000));
+    trace.started = true;
+}
+
+static void write_heap_counter(void)
+{
+    begin_event("refmem heap", 'C', refmem_now_ns());
+    fprintf(trace.out, ",\"args\":{\"objects\":%zu,\"bytes\":%zu}}",
+            trace.live_objects, trace.live_bytes);
+}
+
+static void on_allocate(obj *object, size_t bytes, void *user)
+{
+    trace.live_objects++;
+    trace.live_bytes += bytes;
+    write_heap_counter();
+}
+
+static void on_free(obj *object, size_t bytes, void *user)
+{
+    /* Objects allocated before the trace started are not counted */
+    if (trace.live_objects > 0)
+    {
+        trace.live_objects--;
+        trace.live_bytes -= bytes < trace.live_bytes ? bytes : trace.live_bytes;
+    }
+    write_heap_counter();
+}
+
+static void on_reallocate(obj *old_object, obj *object, size_t old_bytes, size_t bytes,
+                          void *user)
+{
+    trace.live_bytes -= old_bytes < trace.live_bytes ? old_bytes : trace.live_bytes;
+    trace.live_bytes += bytes;
+    write_heap_counter();
+}
+
+static void write_refcount(const char *name, obj *object, size_t rc)
+{
+    begin_event(name, 'i', refmem_now_ns());
+    fprintf(trace.out, ",\"s\":\"t\",\"args\":{\"object\":\"%p\",\"rc\":%zu}}", object, rc);
+}
+
+static void on_retain(obj *object, size_t rc, void *user)
+{
+    write_refcount("retain", object, rc);
+}
+
+static void on_release(obj *object, size_t rc, void *user)
+{
+    write_refcount("release", object, rc);
+}
+
+static void on_cascade_end(const refmem_pause_t *pause, void *user)
+{
+    /* Most allocations find no garbage, leave those out of the timeline */
+    if (pause->objects_freed == 0)
+    {
+        return;
+    }
+    begin_event(refmem_pause_kind_name(pause->kind), 'X', pause->start_ns);
+    fprintf(trace.out, ",\"dur\":%llu.%03u,\"args\":{\"objects\":%zu,\"bytes\":%zu}}",
+            (unsigned long long)(pause->duration_ns / 1000), (unsigned)(pause->duration_ns % 1000),
+            pause->objects_freed, pause->bytes_freed);
+}
+
+bool refmem_chrome_trace_start(FILE *out, bool refcounts)
+{
+    refmem_hooks_t hooks = {
+        .on_allocate = on_allocate,
+        .on_free = on_free,
+        .on_reallocate = on_reallocate,
+        .on_retain = refcounts ? on_retain : NULL,
+        .on_release = refcounts ? on_release : NULL,
+        .on_cascade_end = on_cascade_end,
+    };
+    if (!refmem_set_hooks(&hooks))
+    {
+        return false;
+    }
+    trace = (trace_t){.out = out, .pid = (long)getpid()};
+    fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    return true;
+}
+
+void refmem_chrome_trace_stop(void)
+{
+    if (!trace.out)
+    {
+        return;
+    }
+    refmem_set_hooks(NULL);
+    fprintf(trace.out, "\n]}\n");
+    fflush(trace.out);
+    trace.out = NULL;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/**
+ * @file refmem_chrome_trace.h
+ * @brief Write refmem events as Chrome trace-event JSON.
+ *
+ * Built on the hooks in refmem_hooks.h, so it needs refmem to be built with
+ * REFMEM_HOOKS (make HOOKS=1). The trace can be opened in Perfetto
+ * (ui.perfetto.dev) or chrome://tracing and contains:
+ *
+ * - a slice for every reclamation episode that freed something, with the
+ *   number of objects and bytes freed,
+ * - a "refmem heap" counter with the live objects and bytes, updated on
+ *   every allocation and free,
+ * - optionally an instant event for every retain and release.
+ */
+
+/// @brief Start writing a trace. Replaces any registered hooks.
+/// @param out the stream to write to, which must stay open until
+///        refmem_chrome_trace_stop
+/// @param refcounts whether to include retain and release events, which can
+///        make the trace very large
+/// @return false if refmem was built without REFMEM_HOOKS
+bool refmem_chrome_trace_start(FILE *out, bool refcounts);
+
+/// @brief Finish the trace and remove the hooks. The stream is not closed.
+void refmem_chrome_trace_stop(void);
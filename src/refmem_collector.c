@@ -0,0 +1,121 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include "mpsc_queue.h"
+#include "refmem_collector.h"
+#include "refmem_internal.h"
+
+// Objects waiting to be freed, linked through their collect_node
+static ref_mpsc_queue_t queue = REF_MPSC_QUEUE_INIT(queue);
+
+static _Atomic size_t queued_bytes = 0;
+static size_t max_bytes = 0;
+
+static atomic_bool running = false;
+static pthread_t thread;
+
+// Guards sleeping and waking up the collector, not the queue
+static pthread_mutex_t wake_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static atomic_bool idle = false;
+static bool stopping = false;
+
+/// @brief Take the oldest object off the queue
+/// @return the object, or NULL if the queue is empty or a push is half done
+static object_t *pop(void)
+{
+    ref_mpsc_node_t *node = ref_mpsc_pop(&queue);
+    return node ? (object_t *)((char *)node - offsetof(object_t, collect_node)) : NULL;
+}
+
+static void *collect(void *extra)
+{
+    while (true)
+    {
+        object_t *object_struct = pop();
+        if (object_struct)
+        {
+            atomic_fetch_sub(&queued_bytes, object_struct->size);
+            refmem_collect(object_struct);
+            continue;
+        }
+
+        /* A producer that pushes after the queue was found empty also sees
+           idle set, and wakes the collector up */
+        pthread_mutex_lock(&wake_lock);
+        atomic_store(&idle, true);
+        if (ref_mpsc_is_empty(&queue) && !stopping)
+        {
+            pthread_cond_wait(&wake, &wake_lock);
+        }
+        atomic_store(&idle, false);
+        bool done = stopping && ref_mpsc_is_empty(&queue);
+        pthread_mutex_unlock(&wake_lock);
+        if (done)
+        {
+            return NULL;
+        }
+    }
+}
+
+bool refmem_collector_enqueue(object_t *object_struct)
+{
+    size_t size = object_struct->size;
+    if (atomic_fetch_add(&queued_bytes, size) + size > max_bytes)
+    {
+        atomic_fetch_sub(&queued_bytes, size);
+        return false;
+    }
+    ref_mpsc_push(&queue, &object_struct->collect_node);
+    if (atomic_load(&idle))
+    {
+        pthread_mutex_lock(&wake_lock);
+        pthread_cond_signal(&wake);
+        pthread_mutex_unlock(&wake_lock);
+    }
+    return true;
+}
+
+bool refmem_collector_start(size_t max_queued_bytes)
+{
+    if (atomic_load(&running))
+    {
+        return false;
+    }
+    max_bytes = max_queued_bytes;
+    /* Set first, so that every refmem call from now on takes the heap lock */
+    atomic_store(&running, true);
+    if (pthread_create(&thread, NULL, collect, NULL) != 0)
+    {
+        atomic_store(&running, false);
+        return false;
+    }
+    refmem_slow_paths |= REFMEM_SLOW_COLLECTOR;
+    return true;
+}
+
+void refmem_collector_stop(void)
+{
+    if (!atomic_load(&running))
+    {
+        return;
+    }
+    pthread_mutex_lock(&wake_lock);
+    stopping = true;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&wake_lock);
+    pthread_join(thread, NULL);
+    stopping = false;
+    atomic_store(&running, false);
+    refmem_slow_paths &= ~REFMEM_SLOW_COLLECTOR;
+}
+
+bool refmem_collector_running(void)
+{
+    return atomic_load(&running);
+}
+
+size_t refmem_collector_queued_bytes(void)
+{
+    return atomic_load(&queued_bytes);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @file refmem_collector.h
+ * @brief A background thread that frees released objects.
+ *
+ * While the collector runs, an object whose reference count drops to 0 in
+ * release() or deallocate() is not destroyed there. It is pushed onto a
+ * lock-free queue instead, and the collector thread runs its destructor and
+ * frees it. Objects released by those destructors are queued in turn, so a
+ * cascade costs the releasing thread one push.
+ *
+ * The queue is bounded by the payload bytes waiting in it. A release that
+ * would go over the bound frees the object on the releasing thread, as if
+ * the collector was not running, which keeps the memory waiting to be freed
+ * in check when the collector falls behind.
+ *
+ * refmem itself is still not thread safe: it may be used from one thread
+ * (besides the collector), which is also the thread that starts and stops
+ * the collector. While the collector runs, every refmem call takes a lock.
+ * The collector holds it while it unlinks and frees an object, but not while
+ * the destructor runs, so the owner's calls do not wait on destructors. A
+ * destructor run by the collector may therefore see the owner's calls in
+ * between its own, except while recording, when it keeps the lock.
+ */
+
+/// @brief Start the collector thread
+/// @param max_queued_bytes the most payload bytes that may wait in the queue
+/// @return false if the collector was already running or no thread could be
+///         started
+bool refmem_collector_start(size_t max_queued_bytes);
+
+/// @brief Stop the collector thread, after it has freed every queued object.
+///        Does nothing if it is not running. shutdown() stops it as well.
+void refmem_collector_stop(void);
+
+/// @brief Whether the collector thread is running
+/// @return true between refmem_collector_start and refmem_collector_stop
+bool refmem_collector_running(void);
+
+/// @brief The payload bytes of the objects waiting to be freed
+/// @return the number of bytes in the queue
+size_t refmem_collector_queued_bytes(void);
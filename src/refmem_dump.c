@@ -0,0 +1,173 @@
+#include <execinfo.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "refmem_dump.h"
+#include "refmem_internal.h"
+
+typedef struct dump_context dump_context_t;
+struct dump_context
+{
+    FILE *out;
+    /// @brief Sorted addresses of all live objects, to recognise edges
+    uintptr_t *addresses;
+    size_t address_count;
+    /// @brief Destructors that already have a record, the index is the id
+    function1_t *destructors;
+    size_t destructor_count;
+    bool failed;
+};
+
+static void write_varint(FILE *out, uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        fputc(byte | (value ? 0x80 : 0), out);
+    } while (value);
+}
+
+static void collect_address(object_t *object_struct, void *extra)
+{
+    dump_context_t *context = extra;
+    context->addresses[context->address_count++] = (uintptr_t)object_struct->object;
+}
+
+static int compare_addresses(const void *a, const void *b)
+{
+    uintptr_t x = *(const uintptr_t *)a;
+    uintptr_t y = *(const uintptr_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static bool is_live(dump_context_t *context, uintptr_t address)
+{
+    return bsearch(&address, context->addresses, context->address_count,
+                   sizeof(uintptr_t), compare_addresses) != NULL;
+}
+
+/// @brief Find a printable name for a destructor
+static void destructor_name(function1_t destructor, char *buf, size_t buf_size)
+{
+    if (destructor == refmem_get_default_destructor())
+    {
+        snprintf(buf, buf_size, "default_destructor");
+        return;
+    }
+
+    /* backtrace_symbols resolves any code address, not just return addresses,
+       e.g. "./store(cell_destructor+0x0) [0x55d0c0a1b2c3]" */
+    void *address = (void *)(uintptr_t)destructor;
+    char **symbols = backtrace_symbols(&address, 1);
+    const char *start = symbols ? strchr(symbols[0], '(') : NULL;
+    size_t length = start ? strcspn(start + 1, "+)") : 0;
+    if (length > 0 && length < buf_size)
+    {
+        memcpy(buf, start + 1, length);
+        buf[length] = '\0';
+    }
+    else
+    {
+        snprintf(buf, buf_size, "%p", address);
+    }
+    free(symbols);
+}
+
+/// @brief Get the id of a destructor, writing its record the first time
+static uint64_t destructor_id(dump_context_t *context, function1_t destructor)
+{
+    for (size_t i = 0; i < context->destructor_count; i++)
+    {
+        if (context->destructors[i] == destructor)
+        {
+            return i;
+        }
+    }
+
+    function1_t *grown = realloc(context->destructors, (context->destructor_count + 1) * sizeof(function1_t));
+    if (!grown)
+    {
+        context->failed = true;
+        return 0;
+    }
+    context->destructors = grown;
+    context->destructors[context->destructor_count] = destructor;
+
+    char name[256];
+    destructor_name(destructor, name, sizeof(name));
+    fputc(REFMEM_DUMP_DESTRUCTOR, context->out);
+    write_varint(context->out, context->destructor_count);
+    write_varint(context->out, strlen(name));
+    fwrite(name, 1, strlen(name), context->out);
+
+    return context->destructor_count++;
+}
+
+static void dump_object(object_t *object_struct, void *extra)
+{
+    dump_context_t *context = extra;
+    uint64_t dtor = destructor_id(context, object_struct->destructor);
+
+    fputc(REFMEM_DUMP_OBJECT, context->out);
+    write_varint(context->out, (uintptr_t)object_struct->object);
+    write_varint(context->out, object_struct->size);
+    write_varint(context->out, object_struct->rc);
+    write_varint(context->out, dtor);
+
+    /* Pointers are only looked for at word aligned offsets, like the default
+       destructor does, and only in the part that may hold them */
+    void **words = object_struct->object;
+    size_t word_count = object_struct->scan_size / sizeof(void *);
+    size_t edge_count = 0;
+    for (size_t i = 0; i < word_count; i++)
+    {
+        edge_count += is_live(context, (uintptr_t)words[i]);
+    }
+    write_varint(context->out, edge_count);
+    for (size_t i = 0; i < word_count; i++)
+    {
+        if (is_live(context, (uintptr_t)words[i]))
+        {
+            write_varint(context->out, (uintptr_t)words[i]);
+        }
+    }
+}
+
+bool refmem_dump_heap(const char *path)
+{
+    FILE *out = fopen(path, "wb");
+    if (!out)
+    {
+        return false;
+    }
+
+    /* Held from the count to the last record, so that an object allocated
+       on the collector thread in between neither overruns addresses nor
+       leaves the END record stale */
+    bool locked = refmem_lock_heap();
+    size_t count = refmem_object_count();
+    dump_context_t context = {.out = out};
+    context.addresses = malloc((count ? count : 1) * sizeof(uintptr_t));
+    if (!context.addresses)
+    {
+        refmem_unlock_heap(locked);
+        fclose(out);
+        return false;
+    }
+    refmem_for_each_object(collect_address, &context);
+    qsort(context.addresses, context.address_count, sizeof(uintptr_t), compare_addresses);
+
+    fwrite(REFMEM_DUMP_MAGIC, 1, 4, out);
+    write_varint(out, REFMEM_DUMP_VERSION);
+    refmem_for_each_object(dump_object, &context);
+    fputc(REFMEM_DUMP_END, out);
+    write_varint(out, count);
+    refmem_unlock_heap(locked);
+
+    free(context.addresses);
+    free(context.destructors);
+    bool failed = context.failed || ferror(out);
+    return fclose(out) == 0 && !failed;
+}
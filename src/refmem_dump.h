@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * @file refmem_dump.h
+ * @brief Binary snapshots of the refmem heap, for offline analysis with
+ * refmem_analyze.
+ *
+ * A dump starts with the four bytes of REFMEM_DUMP_MAGIC followed by the
+ * format version, and continues with a stream of records that each start
+ * with a one byte tag. All numbers are unsigned LEB128 varints.
+ *
+ *   REFMEM_DUMP_DESTRUCTOR  id, name length, name bytes
+ *   REFMEM_DUMP_OBJECT      address, size, rc, destructor id,
+ *                           edge count, edge addresses
+ *   REFMEM_DUMP_END         object count
+ *
+ * A destructor record comes before the first object that uses it. Edges are
+ * the words of an object's payload that hold the address of another live
+ * object, found the same way as the default destructor finds them. Objects
+ * allocated with REFMEM_UNINIT have no edges, and the trailer of an object
+ * (see allocate_ex) is only searched if it was allocated with
+ * REFMEM_SCAN_TRAILER.
+ */
+
+#define REFMEM_DUMP_MAGIC "RMHD"
+#define REFMEM_DUMP_VERSION 1
+
+#define REFMEM_DUMP_DESTRUCTOR 'D'
+#define REFMEM_DUMP_OBJECT 'O'
+#define REFMEM_DUMP_END 'E'
+
+/// @brief Write a snapshot of every live object to a file
+/// @param path the file to write, which is replaced if it exists
+/// @return true if the snapshot was written, false on I/O or allocation errors
+bool refmem_dump_heap(const char *path);
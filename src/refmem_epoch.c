@@ -0,0 +1,208 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "refmem_epoch.h"
+#include "refmem_internal.h"
+
+// The epoch of a slot whose thread is not reading
+#define QUIESCENT UINT64_MAX
+
+typedef struct slot slot_t;
+struct slot
+{
+    /// @brief The global epoch when the thread entered, QUIESCENT outside
+    _Atomic uint64_t epoch;
+    atomic_bool taken;
+};
+
+typedef struct retired retired_t;
+struct retired
+{
+    obj *object;
+    /// @brief Readers that entered in this epoch or earlier may see the object
+    uint64_t epoch;
+};
+
+static _Atomic uint64_t global_epoch = 0;
+static slot_t slots[REFMEM_EPOCH_MAX_THREADS];
+static atomic_bool slots_ready = false;
+static pthread_once_t slots_once = PTHREAD_ONCE_INIT;
+static pthread_key_t slot_key;
+
+static _Thread_local slot_t *own_slot = NULL;
+static _Thread_local size_t depth = 0;
+
+// Releases held back, oldest first. Touched under the heap lock, which makes
+// the owner and the collector thread take turns while the collector runs.
+static retired_t *retired = NULL;
+static size_t retired_first = 0;
+static size_t retired_count = 0;
+static size_t retired_capacity = 0;
+
+static void give_back_slot(void *slot)
+{
+    atomic_store(&((slot_t *)slot)->epoch, QUIESCENT);
+    atomic_store(&((slot_t *)slot)->taken, false);
+}
+
+static void init_slots(void)
+{
+    for (size_t i = 0; i < REFMEM_EPOCH_MAX_THREADS; i++)
+    {
+        atomic_store(&slots[i].epoch, QUIESCENT);
+    }
+    pthread_key_create(&slot_key, give_back_slot);
+    atomic_store(&slots_ready, true);
+}
+
+/// @brief Find a free slot for the calling thread
+/// @return the slot, or NULL if all are taken
+static slot_t *take_slot(void)
+{
+    pthread_once(&slots_once, init_slots);
+    for (size_t i = 0; i < REFMEM_EPOCH_MAX_THREADS; i++)
+    {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&slots[i].taken, &expected, true))
+        {
+            pthread_setspecific(slot_key, &slots[i]);
+            return &slots[i];
+        }
+    }
+    return NULL;
+}
+
+bool refmem_epoch_enter(void)
+{
+    if (!own_slot)
+    {
+        own_slot = take_slot();
+        if (!own_slot)
+        {
+            return false;
+        }
+    }
+    if (depth++ == 0)
+    {
+        /* Sequentially consistent, so the owner either sees the slot or
+           unlinked the object before this thread reads the structure */
+        atomic_store(&own_slot->epoch, atomic_load(&global_epoch));
+    }
+    return true;
+}
+
+void refmem_epoch_exit(void)
+{
+    if (depth > 0 && --depth == 0)
+    {
+        atomic_store(&own_slot->epoch, QUIESCENT);
+    }
+}
+
+/// @brief The oldest epoch that a reader is in
+/// @return the epoch, QUIESCENT if no thread is reading
+static uint64_t oldest_reader(void)
+{
+    uint64_t oldest = QUIESCENT;
+    if (!atomic_load(&slots_ready))
+    {
+        return oldest;
+    }
+    for (size_t i = 0; i < REFMEM_EPOCH_MAX_THREADS; i++)
+    {
+        uint64_t epoch = atomic_load(&slots[i].epoch);
+        if (epoch < oldest)
+        {
+            oldest = epoch;
+        }
+    }
+    return oldest;
+}
+
+size_t refmem_epoch_reclaim(void)
+{
+    bool locked = refmem_lock_heap();
+    size_t released = 0;
+    if (retired_count > 0)
+    {
+        uint64_t oldest = oldest_reader();
+        /* The epochs only grow, so the releases that are due come first */
+        while (retired_count > 0 && retired[retired_first].epoch < oldest)
+        {
+            obj *object = retired[retired_first].object;
+            retired_first = (retired_first + 1) % retired_capacity;
+            retired_count--;
+            release(object);
+            released++;
+        }
+    }
+    refmem_unlock_heap(locked);
+    return released;
+}
+
+/// @brief Make room for one more held back release
+/// @return false if there is no memory for it
+static bool grow_retired(void)
+{
+    size_t capacity = retired_capacity ? 2 * retired_capacity : 64;
+    retired_t *grown = malloc(capacity * sizeof(retired_t));
+    if (!grown)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < retired_count; i++)
+    {
+        grown[i] = retired[(retired_first + i) % retired_capacity];
+    }
+    free(retired);
+    retired = grown;
+    retired_first = 0;
+    retired_capacity = capacity;
+    return true;
+}
+
+void refmem_epoch_release(obj *object)
+{
+    bool locked = refmem_lock_heap();
+    uint64_t epoch = atomic_fetch_add(&global_epoch, 1);
+    /* Without memory to hold it back, wait for held back releases to make
+       room, or for every reader that may see the object to exit, after
+       which it is released at once */
+    while (retired_count == retired_capacity && !grow_retired())
+    {
+        if (oldest_reader() > epoch)
+        {
+            release(object);
+            refmem_unlock_heap(locked);
+            return;
+        }
+        if (refmem_epoch_reclaim() == 0)
+        {
+            sched_yield();
+        }
+    }
+    retired[(retired_first + retired_count) % retired_capacity] = (retired_t){
+        .object = object,
+        .epoch = epoch};
+    retired_count++;
+    refmem_unlock_heap(locked);
+}
+
+size_t refmem_epoch_pending(void)
+{
+    bool locked = refmem_lock_heap();
+    size_t pending = retired_count;
+    refmem_unlock_heap(locked);
+    return pending;
+}
+
+void refmem_epoch_discard(void)
+{
+    free(retired);
+    retired = NULL;
+    retired_first = 0;
+    retired_count = 0;
+    retired_capacity = 0;
+}
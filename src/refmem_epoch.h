@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "refmem.h"
+
+/**
+ * @file refmem_epoch.h
+ * @brief Epoch-based reclamation for readers that do not retain.
+ *
+ * A reader that walks a shared structure, e.g. the buckets of a hash table,
+ * can bracket the walk with refmem_epoch_enter() and refmem_epoch_exit()
+ * instead of retaining and releasing every object it passes. It must not
+ * keep pointers to the objects after it exits.
+ *
+ * The owner of the heap unlinks an object from the structure and then gives
+ * up its reference with refmem_epoch_release() instead of release(). The
+ * release is held back until every reader that was inside an epoch at the
+ * time has exited it, since those readers may still see the object. Readers
+ * that enter later cannot reach it any more. Held back releases are done by
+ * refmem_epoch_reclaim() and at the start of allocate().
+ *
+ * Any thread may be a reader, up to REFMEM_EPOCH_MAX_THREADS at a time. A
+ * thread's slot is given back when the thread exits.
+ */
+
+/// @brief The most threads that can be readers at the same time
+#define REFMEM_EPOCH_MAX_THREADS 128
+
+/// @brief Start a read-side section on the calling thread. Sections nest.
+/// @return false if all reader slots are taken, in which case the caller
+///         must retain the objects it reads
+bool refmem_epoch_enter(void);
+
+/// @brief End the read-side section started by the matching
+///        refmem_epoch_enter
+void refmem_epoch_exit(void);
+
+/// @brief Release an object once no reader can still see it. Called by the
+///        owner of the heap, after the object was unlinked.
+/// @param object the object to release
+void refmem_epoch_release(obj *object);
+
+/// @brief Do the releases that no reader holds back any more
+/// @return the number of objects released
+size_t refmem_epoch_reclaim(void);
+
+/// @brief The number of releases that are held back
+/// @return the number of objects waiting for readers to exit
+size_t refmem_epoch_pending(void);
@@ -0,0 +1,16 @@
+#include "refmem_hooks.h"
+
+#ifdef REFMEM_HOOKS
+refmem_hooks_t refmem_active_hooks = {0};
+#endif
+
+bool refmem_set_hooks(const refmem_hooks_t *hooks)
+{
+#ifdef REFMEM_HOOKS
+    refmem_active_hooks = hooks ? *hooks : (refmem_hooks_t){0};
+    return true;
+#else
+    (void)hooks;
+    return false;
+#endif
+}
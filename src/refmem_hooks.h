@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "refmem.h"
+#include "refmem_pause.h"
+
+/**
+ * @file refmem_hooks.h
+ * @brief Callbacks on refmem lifecycle events.
+ *
+ * A program can register one table of callbacks that refmem calls on every
+ * allocation, retain, release, reallocation and free, and at the start and end of every
+ * reclamation episode (see refmem_pause.h). Unset callbacks are skipped.
+ *
+ * The calls are only compiled in when refmem is built with REFMEM_HOOKS
+ * defined (make HOOKS=1). Otherwise every call site expands to nothing and
+ * refmem_set_hooks() refuses the table.
+ *
+ * Callbacks run in the middle of refmem operations and must not call
+ * allocate, retain, release or any other function that changes the heap.
+ */
+
+typedef struct refmem_hooks refmem_hooks_t;
+struct refmem_hooks
+{
+    /// @brief Called after an object has been allocated
+    void (*on_allocate)(obj *object, size_t bytes, void *user);
+    /// @brief Called after an object's reference count was increased
+    void (*on_retain)(obj *object, size_t rc, void *user);
+    /// @brief Called after an object's reference count was decreased, before
+    ///        the object is freed if the count reached 0
+    void (*on_release)(obj *object, size_t rc, void *user);
+    /// @brief Called after an object's destructor has run, just before its
+    ///        memory is freed
+    void (*on_free)(obj *object, size_t bytes, void *user);
+    /// @brief Called after reallocate has resized an object, which may have
+    ///        moved from old_object to object
+    void (*on_reallocate)(obj *old_object, obj *object, size_t old_bytes, size_t bytes,
+                          void *user);
+    /// @brief Called when a reclamation episode starts
+    void (*on_cascade_begin)(refmem_pause_kind_t kind, uint64_t start_ns, void *user);
+    /// @brief Called when a reclamation episode ends, also when it freed nothing
+    void (*on_cascade_end)(const refmem_pause_t *pause, void *user);
+    /// @brief Passed on to every callback
+    void *user;
+};
+
+/// @brief Register the callbacks, replacing any registered before
+/// @param hooks the callbacks, which are copied, or NULL to remove them
+/// @return false if refmem was built without REFMEM_HOOKS
+bool refmem_set_hooks(const refmem_hooks_t *hooks);
+
+// Used by refmem.c and refmem_pause.c
+
+#ifdef REFMEM_HOOKS
+extern refmem_hooks_t refmem_active_hooks;
+
+#define REFMEM_HOOK(name, ...)                                              \
+    do                                                                      \
+    {                                                                       \
+        if (refmem_active_hooks.name)                                       \
+        {                                                                   \
+            refmem_active_hooks.name(__VA_ARGS__, refmem_active_hooks.user); \
+        }                                                                   \
+    } while (0)
+#else
+#define REFMEM_HOOK(name, ...) ((void)0)
+#endif
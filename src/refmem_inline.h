@@ -0,0 +1,70 @@
+#pragma once
+
+#include "refmem.h"
+#include "refmem_internal.h"
+
+/**
+ * @file refmem_inline.h
+ * @brief retain and release, inlined at the call site for the common case.
+ *
+ * retain() and release() find an object's struct by walking the list of
+ * every allocated object, which also lets them ignore pointers that are not
+ * objects. retain_inline and release_inline instead read the struct's
+ * address from the word just before the payload, and change the reference
+ * count in place. They call retain() and release() only when the count drops
+ * to 0, and while the collector thread runs, a trace is recorded or refmem
+ * is built with REFMEM_HOOKS or REFMEM_CHECKED, since those need the
+ * bookkeeping done there.
+ *
+ * The object must be NULL or a pointer returned by one of the allocate
+ * functions that has not been freed. A pointer into an object, or to memory
+ * refmem did not allocate, is not detected as it is by release().
+ */
+
+/// @brief Increase the reference count of an object, see retain
+/// @param object an object returned by one of the allocate functions, or NULL
+static inline void retain_inline(obj *object)
+{
+#if defined(REFMEM_HOOKS) || defined(REFMEM_CHECKED)
+    retain(object);
+#else
+    if (!object)
+    {
+        return;
+    }
+    if (refmem_slow_paths)
+    {
+        retain(object);
+        return;
+    }
+    object_t *object_struct = refmem_header(object);
+    if (!object_struct->immortal)
+    {
+        object_struct->rc++;
+    }
+#endif
+}
+
+/// @brief Decrease the reference count of an object, see release. Freeing
+///        the object is left to release.
+/// @param object an object returned by one of the allocate functions, or NULL
+static inline void release_inline(obj *object)
+{
+#if defined(REFMEM_HOOKS) || defined(REFMEM_CHECKED)
+    release(object);
+#else
+    if (!object)
+    {
+        return;
+    }
+    object_t *object_struct = refmem_header(object);
+    if (refmem_slow_paths || object_struct->rc <= 1)
+    {
+        release(object);
+    }
+    else if (!object_struct->immortal)
+    {
+        object_struct->rc--;
+    }
+#endif
+}
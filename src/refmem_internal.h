@@ -1,5 +1,14 @@
 // Type definitions for internal use in refmem.c and for use in refmem unit tests
+#pragma once
+#if defined(REFMEM_CHECKED) && defined(REFMEM_FAST)
+#error "REFMEM_CHECKED and REFMEM_FAST cannot be used together"
+#endif
+#include <stdatomic.h>
+#include "mpsc_queue.h"
 #include "refmem.h"
+#include "refmem_pause.h"
+#include "refmem_sample.h"
+#include "refmem_sites.h"
 
 typedef struct object object_t;
 struct object
@@ -10,6 +19,109 @@ struct object
     size_t rc;
     /// @brief The size of the object in bytes
     size_t size;
+    /// @brief The alignment the payload was allocated with, 0 for malloc's
+    size_t alignment;
     /// @brief The destructor to run when the object is deallocated
     function1_t destructor;
+    /// @brief The call site that allocated the object, NULL if not tracked
+    refmem_site_t *site;
+    /// @brief The heap profiler's record of the object, NULL if not sampled
+    refmem_sample_t *sample;
+    /// @brief Whether the object is waiting to be freed by the collector or by
+    ///        the release_many call that released it
+    bool free_pending;
+    /// @brief Set by refmem_freeze, the reference count is no longer kept
+    bool immortal;
+    /// @brief The number of bytes at the start of the payload that may hold
+    ///        pointers. The default destructor and heap dumps look no further.
+    size_t scan_size;
+    /// @brief Set for objects allocated with REFMEM_UNINIT, which are not zeroed
+    ///        and never scanned
+    bool uninit;
+    /// @brief Links the object into the collector's queue
+    ref_mpsc_node_t collect_node;
+    /// @brief Links the object into the queue of remote releases, see
+    ///        refmem_remote.h
+    ref_mpsc_node_t remote_node;
+    /// @brief The number of releases other threads have queued for the
+    ///        object. The object is in the queue while it is not 0, and is
+    ///        not freed until they are done.
+    _Atomic size_t remote_releases;
 };
+
+/// @brief Reasons for retain_inline and release_inline to call retain and
+///        release instead, see refmem_inline.h
+enum refmem_slow_path
+{
+    /// @brief The collector thread runs, so the heap lock must be taken
+    REFMEM_SLOW_COLLECTOR = 1,
+    /// @brief A trace is being recorded
+    REFMEM_SLOW_RECORD = 2,
+    /// @brief shutdown() runs destructors, which makes retain and release no-ops
+    REFMEM_SLOW_SHUTDOWN = 4,
+};
+
+/// @brief The refmem_slow_path reasons that hold at the moment, 0 in the
+///        common case
+extern unsigned refmem_slow_paths;
+
+/// @brief Get an object's struct without looking it up in object_list. Its
+///        address is kept in the word just before the payload.
+/// @param object an object returned by one of the allocate functions, not a
+///        pointer into it
+/// @return the object's struct
+static inline object_t *refmem_header(obj *object)
+{
+    return ((object_t **)object)[-1];
+}
+
+/// @brief Call a function on the struct of every allocated object, oldest first
+/// @param fun the function to call
+/// @param extra passed on to every call of fun
+void refmem_for_each_object(void (*fun)(object_t *object_struct, void *extra), void *extra);
+
+/// @brief The number of allocated objects
+/// @return the number of objects that have been allocated but not yet freed
+size_t refmem_object_count(void);
+
+/// @brief Take the heap lock if the collector thread runs. Every function that
+///        reads or changes the heap holds it.
+/// @return whether the lock was taken, to be passed to refmem_unlock_heap
+bool refmem_lock_heap(void);
+
+/// @brief Release the heap lock
+/// @param locked what refmem_lock_heap returned
+void refmem_unlock_heap(bool locked);
+
+/// @brief Hand an object with reference count 0 to the collector thread, see
+///        refmem_collector.h
+/// @param object_struct the struct of the object
+/// @return false if the queue is full, the caller must free the object
+bool refmem_collector_enqueue(object_t *object_struct);
+
+/// @brief Free an object taken off the collector's queue, unless it was
+///        retained again in the meantime. Called on the collector thread.
+/// @param object_struct the struct of the object
+void refmem_collect(object_t *object_struct);
+
+/// @brief Drop every release queued by refmem_release_remote without doing
+///        it, called by shutdown
+void refmem_remote_discard(void);
+
+/// @brief Drop every release held back by refmem_epoch_release without doing
+///        it, called by shutdown
+void refmem_epoch_discard(void);
+
+/// @brief The destructor used for objects allocated without one
+/// @return the default destructor
+function1_t refmem_get_default_destructor(void);
+
+/// @brief The name of a kind of reclamation episode, as reports and traces
+///        show it
+/// @param kind the kind, not REFMEM_PAUSE_KINDS
+/// @return the name
+const char *refmem_pause_kind_name(refmem_pause_kind_t kind);
+
+/// @brief Read the monotonic clock
+/// @return the time in nanoseconds
+uint64_t refmem_now_ns(void);
@@ -0,0 +1,266 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdatomic.h>
+#include <time.h>
+#include "refmem_hooks.h"
+#include "refmem_internal.h"
+#include "refmem_pause.h"
+
+// Four sub-buckets per power of two, which is enough to tell p50 from p99
+#define HISTOGRAM_BUCKETS 256
+
+typedef struct slot slot_t;
+struct slot
+{
+    /// @brief 2 * episode number + 1 while being written, + 2 when done
+    _Atomic uint64_t seq;
+    refmem_pause_t pause;
+};
+
+typedef struct histogram histogram_t;
+struct histogram
+{
+    _Atomic uint64_t buckets[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t episodes;
+    _Atomic uint64_t objects_freed;
+    _Atomic uint64_t bytes_freed;
+    _Atomic uint64_t max_ns;
+};
+
+static slot_t ring[REFMEM_PAUSE_RING_SIZE];
+static _Atomic uint64_t ring_head = 0;
+static histogram_t histograms[REFMEM_PAUSE_KINDS];
+
+static FILE *shutdown_stream = NULL;
+
+// The episode currently in progress
+static size_t depth = 0;
+static refmem_pause_t current;
+
+static const char *kind_names[REFMEM_PAUSE_KINDS] = {
+    "allocate", "cleanup", "cascade", "shutdown"};
+
+const char *refmem_pause_kind_name(refmem_pause_kind_t kind)
+{
+    return kind_names[kind];
+}
+
+uint64_t refmem_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/// @brief Map a duration to its histogram bucket
+static size_t bucket_index(uint64_t ns)
+{
+    if (ns < 4)
+    {
+        return ns;
+    }
+    size_t msb = 63 - __builtin_clzll(ns);
+    size_t sub = (ns >> (msb - 2)) & 3;
+    return msb * 4 + sub;
+}
+
+/// @brief The largest duration that maps to a histogram bucket
+static uint64_t bucket_upper_bound(size_t index)
+{
+    if (index < 8)
+    {
+        return index;
+    }
+    size_t msb = index / 4;
+    uint64_t sub = index % 4;
+    return ((5 + sub) << (msb - 2)) - 1;
+}
+
+static void record(refmem_pause_t *pause)
+{
+    uint64_t n = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    slot_t *slot = &ring[n % REFMEM_PAUSE_RING_SIZE];
+
+    atomic_store_explicit(&slot->seq, 2 * n + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->pause = *pause;
+    atomic_store_explicit(&slot->seq, 2 * n + 2, memory_order_release);
+    atomic_store_explicit(&ring_head, n + 1, memory_order_release);
+
+    histogram_t *h = &histograms[pause->kind];
+    atomic_fetch_add_explicit(&h->buckets[bucket_index(pause->duration_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->episodes, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->objects_freed, pause->objects_freed, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->bytes_freed, pause->bytes_freed, memory_order_relaxed);
+    if (pause->duration_ns > atomic_load_explicit(&h->max_ns, memory_order_relaxed))
+    {
+        atomic_store_explicit(&h->max_ns, pause->duration_ns, memory_order_relaxed);
+    }
+}
+
+void refmem_pause_begin(refmem_pause_kind_t kind)
+{
+    if (depth++ == 0)
+    {
+        current = (refmem_pause_t){.kind = kind, .start_ns = refmem_now_ns()};
+        REFMEM_HOOK(on_cascade_begin, kind, current.start_ns);
+    }
+}
+
+void refmem_pause_note_free(size_t bytes)
+{
+    current.objects_freed++;
+    current.bytes_freed += bytes;
+}
+
+void refmem_pause_end(void)
+{
+    if (depth == 0 || --depth > 0)
+    {
+        return;
+    }
+    if (current.objects_freed > 0)
+    {
+        current.duration_ns = refmem_now_ns() - current.start_ns;
+        record(&current);
+    }
+#ifdef REFMEM_HOOKS
+    if (current.objects_freed == 0)
+    {
+        current.duration_ns = refmem_now_ns() - current.start_ns;
+    }
+    REFMEM_HOOK(on_cascade_end, &current);
+#endif
+}
+
+size_t refmem_pause_recent(refmem_pause_t *buf, size_t max)
+{
+    uint64_t head = atomic_load_explicit(&ring_head, memory_order_acquire);
+    uint64_t first = head > REFMEM_PAUSE_RING_SIZE ? head - REFMEM_PAUSE_RING_SIZE : 0;
+    if (head - first > max)
+    {
+        first = head - max;
+    }
+
+    size_t copied = 0;
+    for (uint64_t n = first; n < head; n++)
+    {
+        slot_t *slot = &ring[n % REFMEM_PAUSE_RING_SIZE];
+        uint64_t before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        refmem_pause_t pause = slot->pause;
+        atomic_thread_fence(memory_order_acquire);
+        uint64_t after = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+
+        /* Skip slots that were overwritten while we read them */
+        if (before == after && before == 2 * n + 2)
+        {
+            buf[copied++] = pause;
+        }
+    }
+    return copied;
+}
+
+refmem_pause_summary_t refmem_pause_summary(refmem_pause_kind_t kind)
+{
+    size_t first = kind == REFMEM_PAUSE_KINDS ? 0 : kind;
+    size_t last = kind == REFMEM_PAUSE_KINDS ? REFMEM_PAUSE_KINDS : kind + 1;
+
+    refmem_pause_summary_t summary = {0};
+    uint64_t buckets[HISTOGRAM_BUCKETS] = {0};
+
+    for (size_t k = first; k < last; k++)
+    {
+        histogram_t *h = &histograms[k];
+        summary.episodes += atomic_load_explicit(&h->episodes, memory_order_relaxed);
+        summary.objects_freed += atomic_load_explicit(&h->objects_freed, memory_order_relaxed);
+        summary.bytes_freed += atomic_load_explicit(&h->bytes_freed, memory_order_relaxed);
+        uint64_t max_ns = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+        summary.max_ns = max_ns > summary.max_ns ? max_ns : summary.max_ns;
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            buckets[b] += atomic_load_explicit(&h->buckets[b], memory_order_relaxed);
+        }
+    }
+
+    uint64_t total = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        total += buckets[b];
+    }
+    if (total == 0)
+    {
+        return summary;
+    }
+
+    /* Rank of the 50th and 99th percentile, rounded up */
+    uint64_t p50_rank = (total * 50 + 99) / 100;
+    uint64_t p99_rank = (total * 99 + 99) / 100;
+    uint64_t seen = 0;
+    for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+    {
+        seen += buckets[b];
+        if (summary.p50_ns == 0 && seen >= p50_rank)
+        {
+            summary.p50_ns = bucket_upper_bound(b);
+        }
+        if (seen >= p99_rank)
+        {
+            summary.p99_ns = bucket_upper_bound(b);
+            break;
+        }
+    }
+    summary.p50_ns = summary.p50_ns < summary.max_ns ? summary.p50_ns : summary.max_ns;
+    summary.p99_ns = summary.p99_ns < summary.max_ns ? summary.p99_ns : summary.max_ns;
+    return summary;
+}
+
+void refmem_pause_reset(void)
+{
+    for (size_t k = 0; k < REFMEM_PAUSE_KINDS; k++)
+    {
+        histogram_t *h = &histograms[k];
+        for (size_t b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            atomic_store_explicit(&h->buckets[b], 0, memory_order_relaxed);
+        }
+        atomic_store_explicit(&h->episodes, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->objects_freed, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->bytes_freed, 0, memory_order_relaxed);
+        atomic_store_explicit(&h->max_ns, 0, memory_order_relaxed);
+    }
+    atomic_store_explicit(&ring_head, 0, memory_order_release);
+}
+
+static void dump_line(FILE *out, const char *name, refmem_pause_summary_t s)
+{
+    fprintf(out, "refmem pause %-8s episodes=%llu objects=%llu bytes=%llu p50=%lluns p99=%lluns max=%lluns\n",
+            name,
+            (unsigned long long)s.episodes,
+            (unsigned long long)s.objects_freed,
+            (unsigned long long)s.bytes_freed,
+            (unsigned long long)s.p50_ns,
+            (unsigned long long)s.p99_ns,
+            (unsigned long long)s.max_ns);
+}
+
+void refmem_pause_dump(FILE *out)
+{
+    for (size_t k = 0; k < REFMEM_PAUSE_KINDS; k++)
+    {
+        dump_line(out, kind_names[k], refmem_pause_summary(k));
+    }
+    dump_line(out, "all", refmem_pause_summary(REFMEM_PAUSE_KINDS));
+}
+
+void refmem_pause_dump_at_shutdown(FILE *out)
+{
+    shutdown_stream = out;
+}
+
+void refmem_pause_shutdown_dump(void)
+{
+    if (shutdown_stream)
+    {
+        refmem_pause_dump(shutdown_stream);
+    }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @file refmem_pause.h
+ * @brief Pause-time instrumentation for refmem.
+ *
+ * Every reclamation episode (the sweep at the start of allocate, cleanup(),
+ * a cascade started by release()/deallocate() and shutdown()) is timed with a
+ * monotonic clock. Nested frees, e.g. destructors releasing their children,
+ * count towards the outermost episode. Episodes that freed nothing are not
+ * recorded.
+ *
+ * The most recent episodes are kept in a ring buffer that may be read from
+ * another thread without locking, and every episode is also added to a
+ * latency histogram per kind of episode.
+ */
+
+/// @brief The number of episodes kept in the ring buffer
+#define REFMEM_PAUSE_RING_SIZE 1024
+
+typedef enum refmem_pause_kind
+{
+    /// @brief The sweep that allocate() runs before allocating
+    REFMEM_PAUSE_ALLOCATE,
+    /// @brief An explicit call to cleanup()
+    REFMEM_PAUSE_CLEANUP,
+    /// @brief A cascade of frees started by release() or deallocate()
+    REFMEM_PAUSE_CASCADE,
+    /// @brief A call to shutdown()
+    REFMEM_PAUSE_SHUTDOWN,
+    /// @brief Number of kinds, also used to ask for a summary of all kinds
+    REFMEM_PAUSE_KINDS
+} refmem_pause_kind_t;
+
+typedef struct refmem_pause refmem_pause_t;
+struct refmem_pause
+{
+    /// @brief What started the episode
+    refmem_pause_kind_t kind;
+    /// @brief Monotonic timestamp of the start of the episode in nanoseconds
+    uint64_t start_ns;
+    /// @brief How long the episode took in nanoseconds
+    uint64_t duration_ns;
+    /// @brief The number of objects freed during the episode
+    size_t objects_freed;
+    /// @brief The number of payload bytes freed during the episode
+    size_t bytes_freed;
+};
+
+typedef struct refmem_pause_summary refmem_pause_summary_t;
+struct refmem_pause_summary
+{
+    /// @brief The number of recorded episodes
+    uint64_t episodes;
+    /// @brief The total number of objects freed by the recorded episodes
+    uint64_t objects_freed;
+    /// @brief The total number of bytes freed by the recorded episodes
+    uint64_t bytes_freed;
+    /// @brief Median episode duration in nanoseconds (histogram resolution)
+    uint64_t p50_ns;
+    /// @brief 99th percentile episode duration in nanoseconds (histogram resolution)
+    uint64_t p99_ns;
+    /// @brief Longest episode duration in nanoseconds (exact)
+    uint64_t max_ns;
+};
+
+/// @brief Copy the most recent episodes, oldest first
+/// @param buf where the episodes are stored
+/// @param max the maximum number of episodes to copy
+/// @return the number of episodes copied
+size_t refmem_pause_recent(refmem_pause_t *buf, size_t max);
+
+/// @brief Summarise the recorded episodes of one kind
+/// @param kind the kind of episode, or REFMEM_PAUSE_KINDS for all of them
+/// @return a summary with percentiles taken from the latency histogram
+refmem_pause_summary_t refmem_pause_summary(refmem_pause_kind_t kind);
+
+/// @brief Forget all recorded episodes
+void refmem_pause_reset(void);
+
+/// @brief Write a human readable summary of all episode kinds
+/// @param out the stream to write to
+void refmem_pause_dump(FILE *out);
+
+/// @brief Make shutdown() write a summary (see refmem_pause_dump) when it is
+/// done. Pass NULL to turn the dump off again, which is the default.
+/// @param out the stream to write to
+void refmem_pause_dump_at_shutdown(FILE *out);
+
+// Used by refmem.c to delimit episodes
+
+/// @brief Start an episode, or join the one already in progress
+/// @param kind what started the episode
+void refmem_pause_begin(refmem_pause_kind_t kind);
+
+/// @brief Account for one object freed in the current episode
+/// @param bytes the size of the freed object
+void refmem_pause_note_free(size_t bytes);
+
+/// @brief End an episode. The outermost call records it.
+void refmem_pause_end(void);
+
+/// @brief Write the summary if refmem_pause_dump_at_shutdown asked for it
+void refmem_pause_shutdown_dump(void);
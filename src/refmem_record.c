@@ -0,0 +1,285 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "refmem_internal.h"
+#include "refmem_record.h"
+
+// The table of live objects is resized when it is more than 3/4 full
+#define INITIAL_CAPACITY 1024
+
+typedef struct entry entry_t;
+struct entry
+{
+    obj *object;
+    uint64_t number;
+};
+
+static FILE *trace = NULL;
+static bool env_checked = false;
+static uint64_t allocated = 0;
+
+// Live objects by address, with linear probing
+static entry_t *table = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+static void write_varint(uint64_t value)
+{
+    do
+    {
+        uint8_t byte = value & 0x7f;
+        value >>= 7;
+        fputc(byte | (value ? 0x80 : 0), trace);
+    } while (value);
+}
+
+static size_t slot_of(entry_t *slots, size_t slots_capacity, obj *object)
+{
+    uintptr_t h = (uintptr_t)object * 0x9E3779B97F4A7C15u;
+    size_t i = (h >> 32) & (slots_capacity - 1);
+    while (slots[i].object && slots[i].object != object)
+    {
+        i = (i + 1) & (slots_capacity - 1);
+    }
+    return i;
+}
+
+static bool grow(void)
+{
+    size_t new_capacity = capacity ? capacity * 2 : INITIAL_CAPACITY;
+    entry_t *new_table = calloc(new_capacity, sizeof(entry_t));
+    if (!new_table)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (table[i].object)
+        {
+            new_table[slot_of(new_table, new_capacity, table[i].object)] = table[i];
+        }
+    }
+    free(table);
+    table = new_table;
+    capacity = new_capacity;
+    return true;
+}
+
+/// @brief Find the number of a live object
+/// @return false if the object was allocated before recording started
+static bool lookup(obj *object, uint64_t *number)
+{
+    if (!table || !object)
+    {
+        return false;
+    }
+    entry_t *entry = &table[slot_of(table, capacity, object)];
+    *number = entry->number;
+    return entry->object != NULL;
+}
+
+/// @brief Remove an object, moving later entries of its probe sequence back
+///        so that lookups do not need tombstones
+static void forget(obj *object)
+{
+    if (!table)
+    {
+        return;
+    }
+    size_t hole = slot_of(table, capacity, object);
+    if (!table[hole].object)
+    {
+        return;
+    }
+    table[hole].object = NULL;
+    count--;
+
+    for (size_t i = (hole + 1) & (capacity - 1); table[i].object; i = (i + 1) & (capacity - 1))
+    {
+        entry_t moved = table[i];
+        table[i].object = NULL;
+        table[slot_of(table, capacity, moved.object)] = moved;
+    }
+}
+
+static void forget_all(void)
+{
+    free(table);
+    table = NULL;
+    capacity = 0;
+    count = 0;
+}
+
+bool refmem_record_start(const char *path)
+{
+    /* Locked, so that the collector thread does not see a half open trace */
+    bool locked = refmem_lock_heap();
+    if (trace)
+    {
+        refmem_unlock_heap(locked);
+        return false;
+    }
+    trace = fopen(path, "wb");
+    if (!trace)
+    {
+        refmem_unlock_heap(locked);
+        return false;
+    }
+    allocated = 0;
+    refmem_slow_paths |= REFMEM_SLOW_RECORD;
+    fwrite(REFMEM_TRACE_MAGIC, 1, 4, trace);
+    write_varint(REFMEM_TRACE_VERSION);
+    refmem_unlock_heap(locked);
+    return true;
+}
+
+bool refmem_record_stop(void)
+{
+    bool locked = refmem_lock_heap();
+    if (!trace)
+    {
+        refmem_unlock_heap(locked);
+        return false;
+    }
+    fputc(REFMEM_TRACE_END, trace);
+    write_varint(allocated);
+    bool failed = ferror(trace);
+    bool closed = fclose(trace) == 0;
+    trace = NULL;
+    refmem_slow_paths &= ~REFMEM_SLOW_RECORD;
+    forget_all();
+    refmem_unlock_heap(locked);
+    return closed && !failed;
+}
+
+bool refmem_recording(void)
+{
+    return trace != NULL;
+}
+
+static void stop_at_exit(void)
+{
+    refmem_record_stop();
+}
+
+void refmem_record_from_env(void)
+{
+    if (env_checked)
+    {
+        return;
+    }
+    env_checked = true;
+    const char *path = getenv("REFMEM_TRACE");
+    if (path && refmem_record_start(path))
+    {
+        atexit(stop_at_exit);
+    }
+}
+
+uint64_t refmem_record_allocate(size_t bytes)
+{
+    if (!trace)
+    {
+        return 0;
+    }
+    fputc(REFMEM_TRACE_ALLOCATE, trace);
+    write_varint(bytes);
+    return allocated++;
+}
+
+void refmem_record_allocated(obj *object, uint64_t number)
+{
+    if (!trace || !object)
+    {
+        return;
+    }
+    if ((count + 1) * 4 > capacity * 3 && !grow())
+    {
+        /* The object stays unknown and calls on it are left out */
+        return;
+    }
+    entry_t *entry = &table[slot_of(table, capacity, object)];
+    count += entry->object == NULL;
+    *entry = (entry_t){.object = object, .number = number};
+}
+
+void refmem_record_object(char tag, obj *object)
+{
+    uint64_t number;
+    if (trace && lookup(object, &number))
+    {
+        fputc(tag, trace);
+        write_varint(allocated - 1 - number);
+    }
+}
+
+void refmem_record_many(char tag, obj **objects, size_t count)
+{
+    if (!trace)
+    {
+        return;
+    }
+    uint64_t number;
+    size_t known = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        known += lookup(objects[i], &number);
+    }
+    fputc(tag, trace);
+    write_varint(known);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (lookup(objects[i], &number))
+        {
+            write_varint(allocated - 1 - number);
+        }
+    }
+}
+
+void refmem_record_reallocate(obj *old_object, obj *object, size_t bytes)
+{
+    uint64_t number;
+    if (trace && lookup(old_object, &number))
+    {
+        fputc(REFMEM_TRACE_REALLOCATE, trace);
+        write_varint(allocated - 1 - number);
+        write_varint(bytes);
+        if (object != old_object)
+        {
+            forget(old_object);
+            refmem_record_allocated(object, number);
+        }
+    }
+}
+
+void refmem_record_destroyed(obj *object)
+{
+    uint64_t number;
+    if (trace && lookup(object, &number))
+    {
+        fputc(REFMEM_TRACE_DESTROYED, trace);
+        forget(object);
+    }
+}
+
+void refmem_record_call(char tag)
+{
+    if (trace)
+    {
+        fputc(tag, trace);
+        if (tag == REFMEM_TRACE_SHUTDOWN)
+        {
+            /* shutdown frees everything without running destructors */
+            forget_all();
+        }
+    }
+}
+
+void refmem_record_cascade_limit(size_t limit)
+{
+    if (trace)
+    {
+        fputc(REFMEM_TRACE_LIMIT, trace);
+        write_varint(limit == SIZE_MAX ? 0 : (uint64_t)limit + 1);
+    }
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "refmem.h"
+
+/**
+ * @file refmem_record.h
+ * @brief Record the calls a program makes into refmem, for replay with
+ * refmem_replay.
+ *
+ * While recording, every call to one of the allocate functions, retain, release,
+ * retain_many, release_many, reallocate, deallocate, cleanup,
+ * set_cascade_limit and shutdown is written to a binary
+ * trace. Objects are numbered in allocation order, so the trace does not
+ * depend on addresses and can be replayed against another build of refmem.
+ *
+ * Calls made by destructors are written between a REFMEM_TRACE_DESTROY record
+ * and a REFMEM_TRACE_DESTROYED record of the object being destroyed. The
+ * replay gives every object a destructor that plays back the calls recorded
+ * for it, so cascades happen in the same order and in the same episode.
+ *
+ * A trace starts with the four bytes of REFMEM_TRACE_MAGIC and the format
+ * version, followed by records that each start with a one byte tag. All
+ * numbers are unsigned LEB128 varints. An object is written as the number of
+ * objects allocated after it, which keeps references to recent objects to a
+ * single byte.
+ *
+ *   REFMEM_TRACE_ALLOCATE    size (the object gets the next number)
+ *   REFMEM_TRACE_RETAIN      object
+ *   REFMEM_TRACE_RELEASE     object
+ *   REFMEM_TRACE_DEALLOCATE  object
+ *   REFMEM_TRACE_CLEANUP
+ *   REFMEM_TRACE_LIMIT       cascade limit + 1, or 0 for SIZE_MAX
+ *   REFMEM_TRACE_SHUTDOWN
+ *   REFMEM_TRACE_FREEZE
+ *   REFMEM_TRACE_REALLOCATE  object, new size
+ *   REFMEM_TRACE_RETAIN_MANY   number of objects, objects
+ *   REFMEM_TRACE_RELEASE_MANY  number of objects, objects
+ *   REFMEM_TRACE_DESTROY     object
+ *   REFMEM_TRACE_DESTROYED
+ *   REFMEM_TRACE_END         number of objects allocated
+ *
+ * Recording can also be started without changing the program by setting the
+ * environment variable REFMEM_TRACE to the path of the trace. It then starts
+ * on the first allocation and stops when the program exits.
+ */
+
+#define REFMEM_TRACE_MAGIC "RMTR"
+#define REFMEM_TRACE_VERSION 2
+
+#define REFMEM_TRACE_ALLOCATE 'A'
+#define REFMEM_TRACE_RETAIN 'R'
+#define REFMEM_TRACE_RELEASE 'L'
+#define REFMEM_TRACE_DEALLOCATE 'F'
+#define REFMEM_TRACE_CLEANUP 'C'
+#define REFMEM_TRACE_LIMIT 'K'
+#define REFMEM_TRACE_SHUTDOWN 'S'
+#define REFMEM_TRACE_FREEZE 'Z'
+#define REFMEM_TRACE_REALLOCATE 'G'
+#define REFMEM_TRACE_RETAIN_MANY 'r'
+#define REFMEM_TRACE_RELEASE_MANY 'l'
+#define REFMEM_TRACE_DESTROY 'D'
+#define REFMEM_TRACE_DESTROYED 'd'
+#define REFMEM_TRACE_END 'E'
+
+/// @brief Start recording calls. Objects that already exist are not in the
+///        trace, and calls on them are left out.
+/// @param path the file to write, which is replaced if it exists
+/// @return false if the file could not be opened or a recording is running
+bool refmem_record_start(const char *path);
+
+/// @brief Stop recording and close the trace
+/// @return false if the trace could not be written completely
+bool refmem_record_stop(void);
+
+// Used by refmem.c. The functions do nothing while not recording.
+
+/// @brief Start recording if REFMEM_TRACE is set. Only looks once.
+void refmem_record_from_env(void);
+
+/// @brief Record a call to one of the allocate functions
+/// @param bytes the size of the object
+/// @return the number of the object, to pass to refmem_record_allocated once
+///         it exists (destructors may allocate in between)
+uint64_t refmem_record_allocate(size_t bytes);
+
+/// @brief Give a new object its number
+/// @param object the new object
+/// @param number the number returned by refmem_record_allocate
+void refmem_record_allocated(obj *object, uint64_t number);
+
+/// @brief Record a call that takes an object
+/// @param tag one of REFMEM_TRACE_RETAIN, _RELEASE, _DEALLOCATE and _DESTROY
+/// @param object the object
+void refmem_record_object(char tag, obj *object);
+
+/// @brief Record a call to retain_many or release_many. The batch is one
+///        record, since release_many frees the objects only after every
+///        count has dropped.
+/// @param tag REFMEM_TRACE_RETAIN_MANY or REFMEM_TRACE_RELEASE_MANY
+/// @param objects the objects, those from before the recording are left out
+/// @param count the number of elements in objects
+void refmem_record_many(char tag, obj **objects, size_t count);
+
+/// @brief Record a call to reallocate that succeeded
+/// @param old_object the object before it was resized
+/// @param object the object after, which keeps its number
+/// @param bytes the new size
+void refmem_record_reallocate(obj *old_object, obj *object, size_t bytes);
+
+/// @brief Whether a recording is running. Called with the heap lock held,
+///        which refmem_record_start and refmem_record_stop also take.
+/// @return true between refmem_record_start and refmem_record_stop
+bool refmem_recording(void);
+
+/// @brief Record the end of a destructor
+/// @param object the destroyed object, which is forgotten
+void refmem_record_destroyed(obj *object);
+
+/// @brief Record a call that takes no object
+/// @param tag REFMEM_TRACE_CLEANUP, REFMEM_TRACE_SHUTDOWN or REFMEM_TRACE_FREEZE
+void refmem_record_call(char tag);
+
+/// @brief Record a call to set_cascade_limit
+/// @param limit the new limit
+void refmem_record_cascade_limit(size_t limit);
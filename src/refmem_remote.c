@@ -0,0 +1,61 @@
+#include <stddef.h>
+#include "mpsc_queue.h"
+#include "refmem_internal.h"
+#include "refmem_remote.h"
+
+// Objects with releases queued, linked through their remote_node
+static ref_mpsc_queue_t queue = REF_MPSC_QUEUE_INIT(queue);
+
+bool refmem_release_remote(obj *object)
+{
+    if (object)
+    {
+        /* Only the first queued release puts the object in the queue, the
+           count tells the owner how many there are */
+        object_t *object_struct = refmem_header(object);
+        if (atomic_fetch_add(&object_struct->remote_releases, 1) == 0)
+        {
+            ref_mpsc_push(&queue, &object_struct->remote_node);
+        }
+    }
+    return true;
+}
+
+/// @brief Take the oldest object off the queue
+/// @return the object's struct, or NULL if there is none
+static object_t *pop(void)
+{
+    ref_mpsc_node_t *node = ref_mpsc_pop(&queue);
+    return node ? (object_t *)((char *)node - offsetof(object_t, remote_node)) : NULL;
+}
+
+size_t refmem_drain_remote(void)
+{
+    /* The heap lock makes the owner and the collector thread take turns as
+       the consumer */
+    bool locked = refmem_lock_heap();
+    size_t released = 0;
+    object_t *next;
+    while ((next = pop()))
+    {
+        /* Taken off the queue first, so a release queued from here on puts
+           it back and is not lost */
+        size_t count = atomic_exchange(&next->remote_releases, 0);
+        for (size_t i = 0; i < count; i++)
+        {
+            release(next->object);
+        }
+        released += count;
+    }
+    refmem_unlock_heap(locked);
+    return released;
+}
+
+void refmem_remote_discard(void)
+{
+    object_t *next;
+    while ((next = pop()))
+    {
+        atomic_store(&next->remote_releases, 0);
+    }
+}
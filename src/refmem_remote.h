@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "refmem.h"
+
+/**
+ * @file refmem_remote.h
+ * @brief Releasing objects from other threads.
+ *
+ * refmem is used from a single thread, the owner of the heap. Another thread
+ * that is done with an object, e.g. a worker the object was handed to, must
+ * not call release(), since that changes the heap under the owner. It calls
+ * refmem_release_remote() instead, which counts the release in the object's
+ * bookkeeping and pushes the object onto a lock-free queue, through a link
+ * kept in that bookkeeping. The producer thus neither touches the heap nor
+ * calls malloc. The owner releases the queued objects at the start of its
+ * next allocate(), or when it calls refmem_drain_remote() at a point of its
+ * choosing.
+ *
+ * Objects released remotely stay allocated until the owner drains the queue.
+ * shutdown() drops the queue along with the heap.
+ */
+
+/// @brief Release an object from any thread. The release happens when the
+///        owner next drains the queue.
+/// @param object an object returned by one of the allocate functions, not a
+///        pointer into it, or NULL
+/// @return true, since queueing the release needs no memory
+bool refmem_release_remote(obj *object);
+
+/// @brief Release every object queued by refmem_release_remote. Called by the
+///        owner of the heap.
+/// @return the number of objects released
+size_t refmem_drain_remote(void);
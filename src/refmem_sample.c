@@ -0,0 +1,262 @@
+#include <execinfo.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "refmem_sample.h"
+
+struct refmem_sample
+{
+    refmem_sample_t *prev;
+    refmem_sample_t *next;
+    /// @brief The size of the sampled object
+    size_t size;
+    /// @brief The number of bytes the sample stands for
+    size_t weight;
+    int depth;
+    void *frames[REFMEM_SAMPLE_MAX_FRAMES];
+};
+
+// The public refmem functions that allocate. Frames up to and including the
+// outermost of these are inside refmem and are left out of the profile.
+static const char *entry_points[] = {
+    "allocate",         "allocate_array",         "allocate_owned", "allocate_array_owned",
+    "allocate_uninit",  "allocate_array_uninit",  "allocate_aligned",
+    "allocate_array_aligned", "allocate_with_trailer", "allocate_ex", "allocate_ex_at"};
+
+static size_t interval = 0;
+static size_t bytes_until_sample = 0;
+static uint64_t rng_state = 0;
+
+// All live samples, newest first
+static refmem_sample_t *samples = NULL;
+static size_t live_samples = 0;
+
+/// @brief xorshift64*, good enough to space out samples
+static uint64_t next_random(void)
+{
+    if (rng_state == 0)
+    {
+        rng_state = (uint64_t)time(NULL) ^ (uintptr_t)&rng_state ^ 0x9E3779B97F4A7C15u;
+    }
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Du;
+}
+
+/// @brief Draw the number of bytes until the next sample from an exponential
+///        distribution with mean `interval`
+static size_t next_sample_distance(void)
+{
+    /* Uniform in (0, 1], so the logarithm is finite */
+    double u = ((next_random() >> 11) + 1) * (1.0 / 9007199254740992.0);
+    double distance = -log(u) * (double)interval;
+    return distance < 1.0 ? 1 : (size_t)distance;
+}
+
+void refmem_sample_set_interval(size_t bytes)
+{
+    interval = bytes;
+    bytes_until_sample = bytes ? next_sample_distance() : 0;
+}
+
+size_t refmem_sample_get_interval(void)
+{
+    return interval;
+}
+
+size_t refmem_sample_live(void)
+{
+    return live_samples;
+}
+
+refmem_sample_t *refmem_sample_allocation(size_t bytes)
+{
+    if (interval == 0)
+    {
+        return NULL;
+    }
+    if (bytes < bytes_until_sample)
+    {
+        bytes_until_sample -= bytes;
+        return NULL;
+    }
+    bytes_until_sample = next_sample_distance();
+
+    refmem_sample_t *sample = calloc(1, sizeof(refmem_sample_t));
+    if (!sample)
+    {
+        return NULL;
+    }
+    sample->size = bytes;
+    /* An object of `bytes` bytes is sampled with probability
+       1 - e^(-bytes/interval), so it stands for bytes divided by that */
+    double probability = 1.0 - exp(-(double)bytes / (double)interval);
+    sample->weight = (size_t)((double)bytes / probability + 0.5);
+    sample->depth = backtrace(sample->frames, REFMEM_SAMPLE_MAX_FRAMES);
+
+    sample->next = samples;
+    if (samples)
+    {
+        samples->prev = sample;
+    }
+    samples = sample;
+    live_samples++;
+    return sample;
+}
+
+void refmem_sample_free(refmem_sample_t *sample)
+{
+    if (sample->prev)
+    {
+        sample->prev->next = sample->next;
+    }
+    else
+    {
+        samples = sample->next;
+    }
+    if (sample->next)
+    {
+        sample->next->prev = sample->prev;
+    }
+    live_samples--;
+    free(sample);
+}
+
+/// @brief Copy the function name out of a backtrace_symbols string, e.g.
+///        "./store(ioopm_merch_create+0x2d) [0x55d0c0a1b2c3]"
+/// @return false if the string carries no function name
+static bool frame_name(const char *symbol, char *buf, size_t buf_size)
+{
+    const char *start = strchr(symbol, '(');
+    if (!start)
+    {
+        return false;
+    }
+    start++;
+    size_t length = strcspn(start, "+)");
+    if (length == 0 || length >= buf_size)
+    {
+        return false;
+    }
+    memcpy(buf, start, length);
+    buf[length] = '\0';
+    return true;
+}
+
+static bool is_entry_point(const char *name)
+{
+    for (size_t i = 0; i < sizeof(entry_points) / sizeof(entry_points[0]); i++)
+    {
+        if (strcmp(name, entry_points[i]) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+typedef struct folded_line folded_line_t;
+struct folded_line
+{
+    char *stack;
+    size_t bytes;
+};
+
+/// @brief Build the ';' separated stack of a sample, outermost frame first
+/// @return a malloc'd string, or NULL
+static char *fold_stack(refmem_sample_t *sample)
+{
+    char **symbols = backtrace_symbols(sample->frames, sample->depth);
+    if (!symbols)
+    {
+        return NULL;
+    }
+
+    char names[REFMEM_SAMPLE_MAX_FRAMES][128];
+    int first_user_frame = 0;
+    for (int i = 0; i < sample->depth; i++)
+    {
+        if (!frame_name(symbols[i], names[i], sizeof(names[i])))
+        {
+            snprintf(names[i], sizeof(names[i]), "%p", sample->frames[i]);
+        }
+        else if (is_entry_point(names[i]))
+        {
+            first_user_frame = i + 1;
+        }
+    }
+    free(symbols);
+
+    size_t length = 1;
+    for (int i = first_user_frame; i < sample->depth; i++)
+    {
+        length += strlen(names[i]) + 1;
+    }
+    char *stack = malloc(length);
+    if (!stack)
+    {
+        return NULL;
+    }
+    stack[0] = '\0';
+    for (int i = sample->depth - 1; i >= first_user_frame; i--)
+    {
+        strcat(stack, names[i]);
+        if (i > first_user_frame)
+        {
+            strcat(stack, ";");
+        }
+    }
+    return stack;
+}
+
+static int compare_stacks(const void *a, const void *b)
+{
+    return strcmp(((const folded_line_t *)a)->stack, ((const folded_line_t *)b)->stack);
+}
+
+void refmem_sample_write_folded(FILE *out)
+{
+    if (live_samples == 0)
+    {
+        return;
+    }
+    folded_line_t *lines = calloc(live_samples, sizeof(folded_line_t));
+    if (!lines)
+    {
+        return;
+    }
+
+    size_t count = 0;
+    for (refmem_sample_t *sample = samples; sample; sample = sample->next)
+    {
+        char *stack = fold_stack(sample);
+        if (stack)
+        {
+            lines[count++] = (folded_line_t){.stack = stack, .bytes = sample->weight};
+        }
+    }
+
+    /* Merge samples with identical stacks */
+    qsort(lines, count, sizeof(folded_line_t), compare_stacks);
+    for (size_t i = 0; i < count;)
+    {
+        size_t bytes = 0;
+        size_t j = i;
+        for (; j < count && strcmp(lines[i].stack, lines[j].stack) == 0; j++)
+        {
+            bytes += lines[j].bytes;
+        }
+        fprintf(out, "%s %zu\n", lines[i].stack, bytes);
+        i = j;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        free(lines[i].stack);
+    }
+    free(lines);
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @file refmem_sample.h
+ * @brief Sampling heap profiler for refmem.
+ *
+ * Allocations are sampled as a Poisson process over allocated bytes: on
+ * average one sample is taken per `interval` bytes, so large objects are
+ * more likely to be sampled than small ones. A sampled object keeps its
+ * backtrace until it is freed, and the profile reports the live sampled
+ * objects scaled up to an estimate of the bytes they represent.
+ *
+ * Sampling is off by default, in which case allocate() pays a single branch.
+ * Function names in the profile need the program to be linked with
+ * -rdynamic (make PROFILE=1), otherwise frames are printed as addresses.
+ */
+
+/// @brief The maximum number of frames kept per sample
+#define REFMEM_SAMPLE_MAX_FRAMES 32
+
+typedef struct refmem_sample refmem_sample_t;
+
+/// @brief Set the mean number of bytes between samples
+/// @param bytes the sampling interval, 0 turns sampling off
+void refmem_sample_set_interval(size_t bytes);
+
+/// @brief Get the mean number of bytes between samples
+/// @return the sampling interval, 0 when sampling is off
+size_t refmem_sample_get_interval(void);
+
+/// @brief The number of sampled objects that are still allocated
+/// @return the number of live samples
+size_t refmem_sample_live(void);
+
+/// @brief Write the live samples in the folded stack format used by
+///        flamegraph.pl and speedscope: one line per distinct stack, with the
+///        frames outermost first separated by ';', followed by the estimated
+///        number of live bytes allocated from that stack.
+/// @param out the stream to write to
+void refmem_sample_write_folded(FILE *out);
+
+// Used by refmem.c
+
+/// @brief Decide whether to sample an allocation and, if so, record it
+/// @param bytes the size of the allocation
+/// @return the sample to keep with the object, or NULL if it is not sampled
+refmem_sample_t *refmem_sample_allocation(size_t bytes);
+
+/// @brief Forget a sampled object that is being freed
+/// @param sample the sample returned by refmem_sample_allocation
+void refmem_sample_free(refmem_sample_t *sample);
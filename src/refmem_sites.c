@@ -0,0 +1,182 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "refmem_sites.h"
+
+// The table is resized when it is more than 3/4 full
+#define INITIAL_CAPACITY 64
+
+static refmem_site_t **table = NULL;
+static size_t capacity = 0;
+static size_t count = 0;
+
+static size_t site_hash(const char *file, int line)
+{
+    uintptr_t h = (uintptr_t)file ^ ((uintptr_t)line * 0x9E3779B97F4A7C15u);
+    h ^= h >> 29;
+    return (size_t)h;
+}
+
+/// @brief Find the slot for a site, or the empty slot where it belongs
+static size_t find_slot(refmem_site_t **slots, size_t slots_capacity, const char *file, int line)
+{
+    size_t i = site_hash(file, line) & (slots_capacity - 1);
+    while (slots[i] && (slots[i]->file != file || slots[i]->line != line))
+    {
+        i = (i + 1) & (slots_capacity - 1);
+    }
+    return i;
+}
+
+static bool grow(void)
+{
+    size_t new_capacity = capacity ? capacity * 2 : INITIAL_CAPACITY;
+    refmem_site_t **new_table = calloc(new_capacity, sizeof(refmem_site_t *));
+    if (!new_table)
+    {
+        return false;
+    }
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (table[i])
+        {
+            new_table[find_slot(new_table, new_capacity, table[i]->file, table[i]->line)] = table[i];
+        }
+    }
+    free(table);
+    table = new_table;
+    capacity = new_capacity;
+    return true;
+}
+
+refmem_site_t *refmem_site_get(const char *file, int line, const char *func)
+{
+    if ((count + 1) * 4 > capacity * 3 && !grow())
+    {
+        return NULL;
+    }
+
+    size_t i = find_slot(table, capacity, file, line);
+    if (!table[i])
+    {
+        refmem_site_t *site = calloc(1, sizeof(refmem_site_t));
+        if (!site)
+        {
+            return NULL;
+        }
+        *site = (refmem_site_t){.file = file, .line = line, .func = func};
+        table[i] = site;
+        count++;
+    }
+    return table[i];
+}
+
+void refmem_site_note_allocate(refmem_site_t *site, size_t bytes)
+{
+    site->live_count++;
+    site->live_bytes += bytes;
+    site->total_allocations++;
+    site->total_bytes += bytes;
+}
+
+void refmem_site_note_resize(refmem_site_t *site, size_t old_bytes, size_t bytes)
+{
+    site->live_bytes = site->live_bytes - old_bytes + bytes;
+    if (bytes > old_bytes)
+    {
+        site->total_bytes += bytes - old_bytes;
+    }
+}
+
+void refmem_site_note_free(refmem_site_t *site, size_t bytes)
+{
+    site->live_count--;
+    site->live_bytes -= bytes;
+}
+
+static int compare_live_bytes(const void *a, const void *b)
+{
+    const refmem_site_t *site_a = *(refmem_site_t *const *)a;
+    const refmem_site_t *site_b = *(refmem_site_t *const *)b;
+
+    if (site_a->live_bytes != site_b->live_bytes)
+    {
+        return site_a->live_bytes < site_b->live_bytes ? 1 : -1;
+    }
+    if (site_a->total_bytes != site_b->total_bytes)
+    {
+        return site_a->total_bytes < site_b->total_bytes ? 1 : -1;
+    }
+    int by_file = strcmp(site_a->file, site_b->file);
+    return by_file != 0 ? by_file : site_a->line - site_b->line;
+}
+
+/// @brief Collect pointers to all sites, sorted by live bytes
+/// @return a malloc'd array of `count` pointers, or NULL
+static refmem_site_t **sorted_sites(void)
+{
+    if (count == 0)
+    {
+        return NULL;
+    }
+    refmem_site_t **sites = malloc(count * sizeof(refmem_site_t *));
+    if (!sites)
+    {
+        return NULL;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < capacity; i++)
+    {
+        if (table[i])
+        {
+            sites[n++] = table[i];
+        }
+    }
+    qsort(sites, n, sizeof(refmem_site_t *), compare_live_bytes);
+    return sites;
+}
+
+size_t refmem_sites(refmem_site_t *buf, size_t max)
+{
+    refmem_site_t **sites = sorted_sites();
+    if (!sites)
+    {
+        return 0;
+    }
+    size_t n = count < max ? count : max;
+    for (size_t i = 0; i < n; i++)
+    {
+        buf[i] = *sites[i];
+    }
+    free(sites);
+    return n;
+}
+
+void refmem_sites_reset(void)
+{
+    for (size_t i = 0; i < capacity; i++)
+    {
+        free(table[i]);
+    }
+    free(table);
+    table = NULL;
+    capacity = 0;
+    count = 0;
+}
+
+void refmem_site_report(FILE *out, size_t max_rows)
+{
+    refmem_site_t **sites = sorted_sites();
+    size_t n = max_rows == 0 || max_rows > count ? count : max_rows;
+
+    fprintf(out, "%12s %10s %12s %14s  %s\n", "live bytes", "live objs", "total allocs", "total bytes", "site");
+    for (size_t i = 0; i < n && sites; i++)
+    {
+        refmem_site_t *site = sites[i];
+        fprintf(out, "%12zu %10zu %12zu %14zu  %s:%d (%s)\n",
+                site->live_bytes, site->live_count, site->total_allocations,
+                site->total_bytes, site->file, site->line, site->func);
+    }
+    free(sites);
+}
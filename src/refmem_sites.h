@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @file refmem_sites.h
+ * @brief Per call site allocation statistics for refmem.
+ *
+ * Compiling a translation unit with REFMEM_TRACK_SITES defined turns its
+ * calls to allocate_ex() and the allocate functions that are shorthands for it
+ * into allocate_ex_at(), which records __FILE__, __LINE__ and __func__ of the
+ * call. Objects allocated through the plain functions are not tracked.
+ *
+ * Sites are keyed on the address of the __FILE__ string and the line, so the
+ * cost per allocation is one hash and a few additions.
+ */
+
+typedef struct refmem_site refmem_site_t;
+struct refmem_site
+{
+    /// @brief The file of the call site, as given by __FILE__
+    const char *file;
+    /// @brief The line of the call site
+    int line;
+    /// @brief The function containing the call site, as given by __func__
+    const char *func;
+    /// @brief The number of objects from this site that are still allocated
+    size_t live_count;
+    /// @brief The number of bytes from this site that are still allocated
+    size_t live_bytes;
+    /// @brief The number of allocations ever made at this site
+    size_t total_allocations;
+    /// @brief The number of bytes ever allocated at this site
+    size_t total_bytes;
+};
+
+/// @brief Copy the statistics of all call sites, sorted by live bytes with
+///        the largest first
+/// @param buf where the statistics are stored
+/// @param max the maximum number of sites to copy
+/// @return the number of sites copied
+size_t refmem_sites(refmem_site_t *buf, size_t max);
+
+/// @brief Forget every call site and its statistics. Objects keep a pointer
+///        to the record of their site, so this may only be called while no
+///        tracked object is allocated, such as right after shutdown().
+void refmem_sites_reset(void);
+
+/// @brief Write a table of the call sites with the most live bytes
+/// @param out the stream to write to
+/// @param max_rows the maximum number of sites to include, 0 for all
+void refmem_site_report(FILE *out, size_t max_rows);
+
+// Used by refmem.c to do the accounting
+
+/// @brief Find or create the record of a call site
+/// @return the record, which stays valid for the life of the program, or NULL
+///         if it could not be allocated
+refmem_site_t *refmem_site_get(const char *file, int line, const char *func);
+
+/// @brief Account for an allocation of `bytes` at `site`
+void refmem_site_note_allocate(refmem_site_t *site, size_t bytes);
+
+/// @brief Account for an object allocated at `site` that was resized from
+///        `old_bytes` to `bytes`
+void refmem_site_note_resize(refmem_site_t *site, size_t old_bytes, size_t bytes);
+
+/// @brief Account for a free of `bytes` allocated at `site`
+void refmem_site_note_free(refmem_site_t *site, size_t bytes);
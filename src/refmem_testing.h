@@ -22,4 +22,4 @@ bool get_struct_index(obj *object, int *index);
 
 void destroy_object(object_t *object_struct);
 
-size_t cleanup_helper(size_t start_index, size_t limit, size_t cleaned_up);
+size_t cleanup_helper(size_t limit);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include "refmem.h"
+
+/**
+ * @file refmem_type.h
+ * @brief Typed allocation for structs whose pointer fields are known at
+ * compile time.
+ *
+ * REFMEM_DEFINE_TYPE(T, field, ...) takes a typedef'd struct T and the names
+ * of its fields that hold references to refmem objects, at most 8, and
+ * defines:
+ *
+ *   T_pointer_offsets   the offsets of those fields, T's pointer map
+ *   T_destructor        a destructor that releases exactly those fields
+ *   T_new()             allocate(sizeof(T), T_destructor), typed
+ *   T_new_owned()       the same with reference count 1, see allocate_owned
+ *
+ * The generated functions are static inline, so every T_new call passes a
+ * constant size and destructor. T_destructor walks the constant pointer map,
+ * which the compiler unrolls into one release per field, instead of scanning
+ * the whole object the way the default destructor does.
+ * REFMEM_DEFINE_PLAIN_TYPE(T) does the same for a struct without references.
+ *
+ *   typedef struct pair pair_t;
+ *   struct pair { pair_t *left; pair_t *right; int value; };
+ *   REFMEM_DEFINE_TYPE(pair_t, left, right)
+ *
+ *   pair_t *p = pair_t_new_owned();
+ */
+
+#define REFMEM_CONCAT_(a, b) a##b
+#define REFMEM_CONCAT(a, b) REFMEM_CONCAT_(a, b)
+
+#define REFMEM_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+#define REFMEM_COUNT(...) REFMEM_COUNT_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+
+// Apply m(T, field) to every field
+#define REFMEM_MAP_1(m, T, a) m(T, a)
+#define REFMEM_MAP_2(m, T, a, ...) m(T, a) REFMEM_MAP_1(m, T, __VA_ARGS__)
+#define REFMEM_MAP_3(m, T, a, ...) m(T, a) REFMEM_MAP_2(m, T, __VA_ARGS__)
+#define REFMEM_MAP_4(m, T, a, ...) m(T, a) REFMEM_MAP_3(m, T, __VA_ARGS__)
+#define REFMEM_MAP_5(m, T, a, ...) m(T, a) REFMEM_MAP_4(m, T, __VA_ARGS__)
+#define REFMEM_MAP_6(m, T, a, ...) m(T, a) REFMEM_MAP_5(m, T, __VA_ARGS__)
+#define REFMEM_MAP_7(m, T, a, ...) m(T, a) REFMEM_MAP_6(m, T, __VA_ARGS__)
+#define REFMEM_MAP_8(m, T, a, ...) m(T, a) REFMEM_MAP_7(m, T, __VA_ARGS__)
+#define REFMEM_MAP(m, T, ...) REFMEM_CONCAT(REFMEM_MAP_, REFMEM_COUNT(__VA_ARGS__))(m, T, __VA_ARGS__)
+
+#define REFMEM_OFFSET_OF_FIELD(T, field) offsetof(T, field),
+
+#define REFMEM_DEFINE_NEW(T)                                       \
+    static inline T *T##_new(void)                                 \
+    {                                                              \
+        return allocate(sizeof(T), T##_destructor);                \
+    }                                                              \
+    static inline T *T##_new_owned(void)                           \
+    {                                                              \
+        return allocate_owned(sizeof(T), T##_destructor);          \
+    }
+
+/// @brief Define the pointer map, destructor and allocation functions of a
+///        struct with the given reference fields
+#define REFMEM_DEFINE_TYPE(T, ...)                                                     \
+    static const size_t T##_pointer_offsets[] = {REFMEM_MAP(REFMEM_OFFSET_OF_FIELD, T, \
+                                                            __VA_ARGS__)};             \
+    static inline void T##_destructor(obj *object)                                     \
+    {                                                                                  \
+        for (size_t i = 0; i < sizeof(T##_pointer_offsets) / sizeof(size_t); i++)      \
+        {                                                                              \
+            release(*(obj **)((char *)object + T##_pointer_offsets[i]));               \
+        }                                                                              \
+    }                                                                                  \
+    REFMEM_DEFINE_NEW(T)
+
+/// @brief Define the destructor and allocation functions of a struct that
+///        holds no references
+#define REFMEM_DEFINE_PLAIN_TYPE(T)                   \
+    static inline void T##_destructor(obj *object)    \
+    {                                                 \
+    }                                                 \
+    REFMEM_DEFINE_NEW(T)
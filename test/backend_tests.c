@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "../demo/store_logic.h"
+#include "../src/refmem_testing.h"
 
 int init_suite(void) { return 0; }
 
@@ -132,6 +133,25 @@ void test_remove_merch(void)
     ioopm_store_destroy(store);
 }
 
+// Removing merch frees it along with its shelves
+void test_remove_merch_and_shelves(void)
+{
+    ioopm_store_t *store = ioopm_store_create();
+    size_t objects = refmem_object_count();
+    char *item[] = {"Foo", "Bar baz", "A25"};
+
+    helper_add_merch_to_store(store, item, 1337, 3);
+    CU_ASSERT_TRUE(ioopm_is_shelf(store, item[2]));
+
+    CU_ASSERT_TRUE(ioopm_merch_remove(store, item[0]));
+    CU_ASSERT_FALSE(ioopm_is_merch(store, item[0]));
+    CU_ASSERT_FALSE(ioopm_is_shelf(store, item[2]));
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), objects);
+
+    ioopm_store_destroy(store);
+}
+
 void test_edit_merch(void)
 {
     ioopm_store_t *store = ioopm_store_create();
@@ -154,6 +174,27 @@ void test_edit_merch(void)
     ioopm_store_destroy(store);
 }
 
+// The strings of an edit replace those the merch was created with, which are
+// part of the merch itself
+void test_edit_merch_strings(void)
+{
+    ioopm_store_t *store = ioopm_store_create();
+    size_t objects = refmem_object_count();
+
+    ioopm_add_merch_to_store(store, "Foo", "Bar baz", 1337);
+    ioopm_merch_edit(store, "Foo", "Fuu", "Bur buz", 3713);
+    merch_t *merch = ioopm_get_merch(store, "Fuu");
+    CU_ASSERT_STRING_EQUAL(ioopm_get_merch_name(merch), "Fuu");
+    CU_ASSERT_STRING_EQUAL(ioopm_get_merch_desc(merch), "Bur buz");
+
+    ioopm_merch_edit(store, "Fuu", "Foo", "Bar baz", 1337);
+    CU_ASSERT_TRUE(ioopm_merch_remove(store, "Foo"));
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), objects);
+
+    ioopm_store_destroy(store);
+}
+
 void test_empty_stores_replenish(void)
 {
     ioopm_store_t *store = ioopm_store_create();
@@ -575,7 +616,9 @@ int main(void)
         (CU_add_test(ioopm_backend_test_suite, "Test store create and destroy", test_store_create) == NULL) || 
         (CU_add_test(ioopm_backend_test_suite, "Test is merch", test_is_merch) == NULL) || 
         (CU_add_test(ioopm_backend_test_suite, "Test add merch", test_add_merch_to_store) == NULL) || 
-        (CU_add_test(ioopm_backend_test_suite, "Test remove merch", test_remove_merch) == NULL) || /*
+        (CU_add_test(ioopm_backend_test_suite, "Test remove merch", test_remove_merch) == NULL) || 
+        (CU_add_test(ioopm_backend_test_suite, "Test remove merch and its shelves", test_remove_merch_and_shelves) == NULL) || 
+        (CU_add_test(ioopm_backend_test_suite, "Test edit merch strings", test_edit_merch_strings) == NULL) || /*
         (CU_add_test(ioopm_backend_test_suite, "Test edit merch", test_edit_merch) == NULL) || 
         (CU_add_test(ioopm_backend_test_suite, "Test replenish empty store", test_empty_stores_replenish) == NULL) || 
         (CU_add_test(ioopm_backend_test_suite, "Test replenish store", test_shelves_replenish) == NULL) || 
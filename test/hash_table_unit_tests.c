@@ -11,6 +11,7 @@
 #include "../demo/linked_list.h"
 #include "../demo/hash_table.h"
 #include "../demo/equality_functions.h"
+#include "../src/refmem_testing.h"
 
 #define Num_buckets 33
 
@@ -51,6 +52,22 @@ void test_create_destroy(void)
     ioopm_hash_table_destroy(ht);
 }
 
+// Test that destroying a hashtable leaves the values it refers to alone
+void test_destroy_keeps_values(void)
+{
+    ioopm_hash_table_t *ht = ioopm_hash_table_create(ioopm_std_hash_function, ioopm_int_equal, ioopm_string_equal);
+    size_t objects = refmem_object_count();
+    char *value = allocate(8, NULL);
+    retain(value);
+    ioopm_hash_table_insert(ht, int_elem(1), ptr_elem(value));
+    ioopm_hash_table_insert(ht, int_elem(1 + Num_buckets), ptr_elem(value));
+    ioopm_hash_table_destroy(ht);
+    cleanup();
+    CU_ASSERT_EQUAL(rc(value), 1);
+    CU_ASSERT_EQUAL(refmem_object_count(), objects);
+    release(value);
+}
+
 // Test lookup on an empty hashtable
 void test_lookup_empty(void)
 {
@@ -725,6 +742,7 @@ int main(void)
     // copy a line below and change the information
     if (
         (CU_add_test(ioopm_hashtable_tests, "Test IOOPM hash: created and destroyed", test_create_destroy) == NULL) || 
+        (CU_add_test(ioopm_hashtable_tests, "Test IOOPM hash: destroy keeps the values", test_destroy_keeps_values) == NULL) ||
         (CU_add_test(ioopm_hashtable_tests, "Test IOOPM hash: lookup on empty hashtable", test_lookup_empty) == NULL) || 
         (CU_add_test(ioopm_hashtable_tests, "Test IOOPM hash: single insert", test_single_insert) == NULL) || 
         (CU_add_test(ioopm_hashtable_tests, "Test IOOPM hash: several inserts", test_several_insert) == NULL) || 
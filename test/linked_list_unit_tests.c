@@ -483,6 +483,23 @@ void test_iterator_create_destroy(void)
     ioopm_linkedlist_destroy(list);
 }
 
+// The iterator releases the list and nodes it holds when destroyed
+void test_iterator_destroy_releases(void)
+{
+    size_t objects = refmem_object_count();
+    ioopm_list_t *list = ioopm_linkedlist_create(ioopm_unsint_equal);
+    fill_list(list, 3);
+    ioopm_list_iterator_t *iter = ioopm_list_iterator(list);
+    bool error = false;
+    ioopm_iterator_next(iter, &error);
+    CU_ASSERT_FALSE(error);
+
+    ioopm_iterator_destroy(iter);
+    ioopm_linkedlist_destroy(list);
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), objects);
+}
+
 void test_iterator_next(void)
 {
     // Creates list and fill with 10 element from 1 to 10
@@ -787,6 +804,7 @@ int main(void)
         (CU_add_test(ioopm_linkedlists_testsuite, "Test linked list: bubblesort strings", test_bubblesort_strings) == NULL) || 
         // Iterator testsuite
         (CU_add_test(ioopm_iterator_testsuite, "Test Iterator", test_iterator_create_destroy) == NULL) || 
+        (CU_add_test(ioopm_iterator_testsuite, "Test Iterator", test_iterator_destroy_releases) == NULL) ||
         (CU_add_test(ioopm_iterator_testsuite, "Test Iterator", test_iterator_current) == NULL) || 
         (CU_add_test(ioopm_iterator_testsuite, "Test Iterator", test_iterator_next) == NULL) || 
         (CU_add_test(ioopm_iterator_testsuite, "Test Iterator", test_iterator_reset) == NULL) || 
@@ -1,9 +1,28 @@
 #include <CUnit/Basic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <assert.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <stdio.h>
+#include <string.h>
 #include "../src/refmem.h"
 #include "../src/refmem_testing.h"
+#include "../src/refmem_chrome_trace.h"
+#include "../src/refmem_collector.h"
+#include "../src/refmem_dump.h"
+#include "../src/refmem_epoch.h"
+#include "../src/refmem_hooks.h"
+#include "../src/refmem_record.h"
+#include "../src/refmem_remote.h"
+#include "../src/refmem_pause.h"
+#include "../src/ref_vec.h"
+#include "../src/refmem_type.h"
+#include "../src/refmem_inline.h"
 
 struct cell
 {
@@ -24,6 +43,15 @@ void cell_destructor(obj *c)
     release(((struct cell *)c)->cell);
 }
 
+static obj *kept = NULL;
+
+/// @brief Keeps the cell an object points to, and allocates another object
+void keep_cell_destructor(obj *c)
+{
+    retain(((struct cell *)c)->cell);
+    allocate_owned(16, NULL);
+}
+
 int clean_suite(void)
 {
     return 0;
@@ -86,6 +114,446 @@ void test_allocate_array(void)
     shutdown();
 }
 
+void test_allocate_owned(void)
+{
+    struct cell *c = allocate_owned(sizeof(struct cell), cell_destructor);
+    CU_ASSERT_EQUAL(rc(c), 1);
+    c->cell = allocate_array_owned(3, sizeof(struct cell), cell_destructor);
+    CU_ASSERT_EQUAL(rc(c->cell), 1);
+
+    // Owned objects are not garbage, so the sweep in allocate leaves them be
+    allocate(16, NULL);
+    CU_ASSERT_EQUAL(refmem_object_count(), 3);
+
+    // Releasing the only reference frees them
+    release(c);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+    CU_ASSERT_PTR_NULL(allocate_array_owned(SIZE_MAX, SIZE_MAX, NULL));
+
+    shutdown();
+}
+
+void test_refmem_move(void)
+{
+    obj *first = allocate_owned(16, NULL);
+    obj *second = allocate_owned(16, NULL);
+    obj *dst = first;
+    obj *src = second;
+
+    // The reference moves, and the one dst held before is released
+    refmem_move(&dst, &src);
+    CU_ASSERT_PTR_EQUAL(dst, second);
+    CU_ASSERT_PTR_NULL(src);
+    CU_ASSERT_EQUAL(rc(second), 1);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    // Moving into an empty place or onto itself changes nothing
+    obj *empty = NULL;
+    refmem_move(&empty, &dst);
+    CU_ASSERT_PTR_EQUAL(empty, second);
+    refmem_move(&empty, &empty);
+    CU_ASSERT_PTR_EQUAL(empty, second);
+    CU_ASSERT_EQUAL(rc(second), 1);
+
+    shutdown();
+}
+
+void test_allocate_uninit(void)
+{
+    struct cell *pointee = allocate_owned(sizeof(struct cell), NULL);
+
+    // Whatever the payload holds, the default destructor does not release it
+    struct cell *c = allocate_ex(sizeof(struct cell), NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0);
+    c->cell = pointee;
+    release(c);
+    CU_ASSERT_EQUAL(rc(pointee), 1);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    // Only the zeroing is skipped, they are counted and freed like others
+    char *buffer = allocate_array_uninit(4096, sizeof(char), NULL);
+    CU_ASSERT_PTR_NOT_NULL(buffer);
+    memset(buffer, 'x', 4096);
+    CU_ASSERT_EQUAL(rc(buffer), 0);
+    CU_ASSERT_EQUAL(rc(allocate_ex(8 * sizeof(int), NULL, REFMEM_OWNED | REFMEM_UNINIT, 0, 0)), 1);
+    CU_ASSERT_EQUAL(rc(allocate_uninit(8, NULL)), 0);
+    CU_ASSERT_PTR_NULL(allocate_array_uninit(SIZE_MAX, SIZE_MAX, NULL));
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+
+    shutdown();
+}
+
+void test_allocate_aligned(void)
+{
+    // retain, release and rc work on the aligned pointers
+    float *floats = allocate_array_aligned(100, sizeof(float), 64, NULL);
+    CU_ASSERT_EQUAL((uintptr_t)floats % 64, 0);
+    CU_ASSERT_EQUAL(floats[99], 0);
+    retain(floats);
+    retain(floats);
+    obj *page = allocate_aligned(100, 4096, NULL);
+    CU_ASSERT_EQUAL((uintptr_t)page % 4096, 0);
+    retain(page);
+    CU_ASSERT_EQUAL(rc(floats), 2);
+    CU_ASSERT_EQUAL(rc(page), 1);
+    release(floats);
+    CU_ASSERT_EQUAL(rc(floats), 1);
+
+    // Resizing keeps the alignment and the contents
+    floats[0] = 1.5f;
+    floats = reallocate(floats, 100000 * sizeof(float));
+    CU_ASSERT_EQUAL((uintptr_t)floats % 64, 0);
+    CU_ASSERT_EQUAL(floats[0], 1.5f);
+    CU_ASSERT_EQUAL(floats[99999], 0);
+    CU_ASSERT_EQUAL(rc(floats), 1);
+
+    release(page);
+    release(floats);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    // Wherever the padding puts the payload, all of it is usable
+    for (size_t alignment = 32; alignment <= 8192; alignment *= 2)
+    {
+        unsigned char *bytes = allocate_aligned(alignment, alignment, NULL);
+        CU_ASSERT_EQUAL((uintptr_t)bytes % alignment, 0);
+        CU_ASSERT_EQUAL(bytes[alignment - 1], 0);
+        memset(bytes, 0xff, alignment);
+        CU_ASSERT_EQUAL(rc(bytes), 0);
+        deallocate(bytes);
+    }
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    // Alignments that are not powers of two are refused, small ones work
+    CU_ASSERT_PTR_NULL(allocate_aligned(16, 48, NULL));
+    CU_ASSERT_PTR_NOT_NULL(allocate_aligned(16, 1, NULL));
+    CU_ASSERT_PTR_NULL(allocate_array_aligned(SIZE_MAX, SIZE_MAX, 64, NULL));
+
+    shutdown();
+}
+
+struct record
+{
+    struct cell *cell;
+    size_t length;
+    char text[];
+};
+
+void test_allocate_with_trailer(void)
+{
+    struct cell *pointee = allocate_owned(sizeof(struct cell), NULL);
+
+    // The tail follows the struct in the same object
+    struct record *r = allocate_ex(sizeof(struct record), NULL, REFMEM_OWNED, 0, 4096);
+    CU_ASSERT_PTR_NOT_NULL(r);
+    CU_ASSERT_EQUAL(r->text[4095], 0);
+    memset(r->text, 'x', 4096);
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+
+    // The tail is not scanned, so an address in it is not released
+    memcpy(r->text, &pointee, sizeof(pointee));
+    retain(pointee);
+    release(r);
+    CU_ASSERT_EQUAL(rc(pointee), 2);
+
+    // Unless it is allocated to be
+    r = allocate_ex(sizeof(struct record), NULL, REFMEM_OWNED | REFMEM_SCAN_TRAILER, 0, 64);
+    memcpy(r->text + 32, &pointee, sizeof(pointee));
+    release(r);
+    CU_ASSERT_EQUAL(rc(pointee), 1);
+    retain(pointee);
+
+    // The header is, as in any other object
+    r = allocate_ex(sizeof(struct record), NULL, REFMEM_OWNED, 0, 16);
+    r->cell = pointee;
+    release(r);
+    CU_ASSERT_EQUAL(rc(pointee), 1);
+    CU_ASSERT_EQUAL(rc(allocate_with_trailer(sizeof(struct record), 0, 0, NULL)), 0);
+    CU_ASSERT_PTR_NULL(allocate_ex(16, NULL, 0, 0, SIZE_MAX));
+    CU_ASSERT_PTR_NULL(allocate_with_trailer(16, SIZE_MAX, 1, NULL));
+    CU_ASSERT_PTR_NULL(allocate_with_trailer(0, SIZE_MAX / 2 + 1, 2, NULL));
+
+    shutdown();
+}
+
+typedef struct pair pair_t;
+struct pair
+{
+    int value;
+    pair_t *left;
+    pair_t *right;
+};
+REFMEM_DEFINE_TYPE(pair_t, left, right)
+
+typedef struct point point_t;
+struct point
+{
+    int x;
+    int y;
+};
+REFMEM_DEFINE_PLAIN_TYPE(point_t)
+
+void test_define_type(void)
+{
+    CU_ASSERT_EQUAL(sizeof(pair_t_pointer_offsets) / sizeof(size_t), 2);
+    CU_ASSERT_EQUAL(pair_t_pointer_offsets[0], offsetof(pair_t, left));
+    CU_ASSERT_EQUAL(pair_t_pointer_offsets[1], offsetof(pair_t, right));
+
+    pair_t *root = pair_t_new_owned();
+    CU_ASSERT_EQUAL(rc(root), 1);
+    root->left = pair_t_new_owned();
+    root->right = pair_t_new_owned();
+    root->left->left = pair_t_new_owned();
+    point_t *point = point_t_new();
+    CU_ASSERT_EQUAL(rc(point), 0);
+    retain(point);
+    CU_ASSERT_EQUAL(refmem_object_count(), 5);
+
+    // The destructor releases the pointer fields, so the whole tree goes
+    release(root);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+    release(point);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    shutdown();
+}
+
+void test_retain_release_inline(void)
+{
+    retain_inline(NULL);
+    release_inline(NULL);
+
+    obj *o = allocate(16, NULL);
+    retain_inline(o);
+    retain_inline(o);
+    CU_ASSERT_EQUAL(rc(o), 2);
+    release_inline(o);
+    CU_ASSERT_EQUAL(rc(o), 1);
+    // The last reference goes through release, which frees the object
+    release_inline(o);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    // The struct is found from aligned and resized payloads as well
+    obj *aligned = allocate_aligned(64, 4096, NULL);
+    retain_inline(aligned);
+    CU_ASSERT_EQUAL(rc(aligned), 1);
+    char *buffer = allocate_owned(16, NULL);
+    buffer = reallocate(buffer, 1 << 16);
+    retain_inline(buffer);
+    CU_ASSERT_EQUAL(rc(buffer), 2);
+    release_inline(buffer);
+    release_inline(buffer);
+    release_inline(aligned);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    // Frozen objects keep their count
+    obj *frozen = allocate_owned(16, NULL);
+    refmem_freeze();
+    retain_inline(frozen);
+    release_inline(frozen);
+    release_inline(frozen);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+    shutdown();
+
+    // While the collector runs, the last release queues the object
+    CU_ASSERT_TRUE(refmem_collector_start(SIZE_MAX));
+    o = allocate(16, NULL);
+    retain_inline(o);
+    release_inline(o);
+    refmem_collector_stop();
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+    shutdown();
+}
+
+#ifdef REFMEM_CHECKED
+static void release_twice(void)
+{
+    obj *o = allocate_owned(16, NULL);
+    release(o);
+    release(o);
+}
+
+static void retain_unmanaged(void)
+{
+    int not_managed;
+    retain(&not_managed);
+}
+
+static void release_interior(void)
+{
+    char *o = allocate_owned(16, NULL);
+    release(o + 8);
+}
+
+static void release_many_freed(void)
+{
+    obj *o = allocate_owned(16, NULL);
+    release(o);
+    release_many(&o, 1);
+}
+
+static void retain_many_unmanaged(void)
+{
+    int not_managed;
+    obj *objects[] = {allocate_owned(16, NULL), &not_managed};
+    retain_many(objects, 2);
+}
+
+/// @brief Run a function in a child process
+/// @return whether the function stopped the program with abort
+static bool aborts(void (*fun)(void))
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // The error message is expected
+        freopen("/dev/null", "w", stderr);
+        fun();
+        _exit(0);
+    }
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT;
+}
+
+void test_checked(void)
+{
+    CU_ASSERT_TRUE(aborts(release_twice));
+    CU_ASSERT_TRUE(aborts(retain_unmanaged));
+    CU_ASSERT_TRUE(aborts(release_interior));
+    CU_ASSERT_TRUE(aborts(release_many_freed));
+    CU_ASSERT_TRUE(aborts(retain_many_unmanaged));
+
+    // The payload is poisoned when it is freed, and kept until shutdown
+    char *o = allocate_owned(16, NULL);
+    release(o);
+    CU_ASSERT_EQUAL((unsigned char)o[0], 0xdd);
+    CU_ASSERT_EQUAL((unsigned char)o[15], 0xdd);
+    shutdown();
+}
+#endif
+
+void test_reallocate(void)
+{
+    char *buffer = allocate_owned(16, NULL);
+    memset(buffer, 'x', 16);
+
+    // The contents, reference count and size carry over, the rest is zeroed
+    buffer = reallocate(buffer, 1 << 16);
+    CU_ASSERT_PTR_NOT_NULL(buffer);
+    CU_ASSERT_EQUAL(buffer[15], 'x');
+    CU_ASSERT_EQUAL(buffer[16], 0);
+    CU_ASSERT_EQUAL(buffer[(1 << 16) - 1], 0);
+    CU_ASSERT_EQUAL(rc(buffer), 1);
+    retain(buffer);
+    CU_ASSERT_EQUAL(rc(buffer), 2);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    // The default destructor still finds a pointer to a moved object, and in it
+    obj *pointee = allocate_owned(16, NULL);
+    obj **holder = allocate_owned(sizeof(obj *), NULL);
+    holder = reallocate(holder, 1 << 16);
+    *holder = pointee;
+    pointee = reallocate(pointee, 1 << 16);
+    *holder = pointee;
+    release(holder);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    // Unknown objects are not resized
+    CU_ASSERT_PTR_NULL(reallocate(NULL, 16));
+#if !defined(REFMEM_CHECKED) && !defined(REFMEM_FAST)
+    int not_managed;
+    CU_ASSERT_PTR_NULL(reallocate(&not_managed, 16));
+#endif
+
+    shutdown();
+}
+
+void test_ref_vec(void)
+{
+    ref_vec_t *vec = ref_vec_create(sizeof(int));
+    CU_ASSERT_PTR_NOT_NULL(vec);
+    CU_ASSERT_EQUAL(rc(vec), 1);
+
+    // The vector grows in place, without changing its address
+    bool pushed = true;
+    for (int i = 0; i < 1000; i++)
+    {
+        pushed = ref_vec_push(vec, &i) && pushed;
+    }
+    CU_ASSERT_TRUE(pushed);
+    CU_ASSERT_EQUAL(ref_vec_length(vec), 1000);
+    CU_ASSERT_EQUAL(*(int *)ref_vec_get(vec, 0), 0);
+    CU_ASSERT_EQUAL(*(int *)ref_vec_get(vec, 999), 999);
+    CU_ASSERT_PTR_NULL(ref_vec_get(vec, 1000));
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+
+    int last;
+    CU_ASSERT_TRUE(ref_vec_pop(vec, &last));
+    CU_ASSERT_EQUAL(last, 999);
+    CU_ASSERT_EQUAL(ref_vec_length(vec), 999);
+
+    // Releasing the vector frees its buffer too
+    release(vec);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    ref_vec_t *empty = ref_vec_create(sizeof(int));
+    CU_ASSERT_FALSE(ref_vec_pop(empty, NULL));
+    shutdown();
+}
+
+void test_retain_release_many(void)
+{
+    obj *a = allocate_owned(16, NULL);
+    obj *b = allocate_owned(32, NULL);
+    obj *c = allocate_owned(16, NULL);
+
+    // NULL is skipped and an object may occur more than once
+    obj *objects[] = {a, b, NULL, a, c};
+    retain_many(objects, 5);
+    CU_ASSERT_EQUAL(rc(a), 3);
+    CU_ASSERT_EQUAL(rc(b), 2);
+    CU_ASSERT_EQUAL(rc(c), 2);
+    release_many(objects, 5);
+    CU_ASSERT_EQUAL(rc(a), 1);
+    CU_ASSERT_EQUAL(rc(b), 1);
+    CU_ASSERT_EQUAL(refmem_object_count(), 3);
+
+    // Objects dropped to 0 are freed, also when one destructor releases another
+    struct cell *x = allocate_owned(sizeof(struct cell), cell_destructor);
+    struct cell *y = allocate_owned(sizeof(struct cell), cell_destructor);
+    x->cell = y;
+    retain(y);
+    obj *dropped[] = {y, c, x, b, a};
+    release_many(dropped, 5);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+#ifndef REFMEM_FAST
+    // Or one the batch dropped as well, which is freed after the destructor
+    // of the older object has run
+    x = allocate_owned(sizeof(struct cell), cell_destructor);
+    y = allocate_owned(sizeof(struct cell), cell_destructor);
+    x->cell = y;
+    obj *both[] = {y, x};
+    release_many(both, 2);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+#endif
+
+    // Only the cascade limit of them are freed, the rest are garbage
+    for (size_t i = 0; i < 3; i++)
+    {
+        objects[i] = allocate_owned(16, NULL);
+    }
+    set_cascade_limit(1);
+    release_many(objects, 3);
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+    set_cascade_limit(SIZE_MAX);
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    shutdown();
+}
+
 void test_allocate_deallocate(void)
 {
     struct cell *c = allocate(sizeof(struct cell), cell_destructor);
@@ -118,6 +586,11 @@ void test_rc(void)
     CU_ASSERT_EQUAL(rc(obj), 1001);
 
     CU_ASSERT_FALSE(rc(NULL));
+#if !defined(REFMEM_CHECKED) && !defined(REFMEM_FAST)
+    // A pointer into an object is not an object, and has no count
+    char *bytes = allocate_owned(16, NULL);
+    CU_ASSERT_EQUAL(rc(bytes + 8), 0);
+#endif
 
     shutdown();
 }
@@ -181,6 +654,37 @@ void test_cleanup(void)
     allocate(5, NULL);
     cleanup();
 
+    /* Garbage between live objects is freed in one sweep, which also frees
+       the garbage its destructors leave. With a cascade limit of 0, allocate
+       leaves the garbage for cleanup. */
+    set_cascade_limit(0);
+    obj *live[10];
+    for (int i = 0; i < 10; i++)
+    {
+        live[i] = allocate_owned(16, NULL);
+        allocate(16, NULL);
+    }
+    struct cell *holder = allocate(sizeof(struct cell), cell_destructor);
+    holder->cell = allocate_owned(16, NULL);
+    CU_ASSERT_EQUAL(refmem_object_count(), 22);
+    set_cascade_limit(SIZE_MAX);
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), 10);
+    release_many(live, 10);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* A destructor may retain garbage the sweep found after it, or allocate */
+    set_cascade_limit(0);
+    struct cell *keeper = allocate(sizeof(struct cell), keep_cell_destructor);
+    keeper->cell = allocate(sizeof(struct cell), NULL);
+    kept = keeper->cell;
+    set_cascade_limit(SIZE_MAX);
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+    CU_ASSERT_EQUAL(rc(kept), 1);
+    release(kept);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+    shutdown();
 }
 
 void test_shutdown(void)
@@ -205,6 +709,317 @@ void test_shutdown(void)
     shutdown();
 }
 
+static int destructed_sum = 0;
+
+void summing_destructor(obj *c)
+{
+    struct cell *cell = c;
+    destructed_sum += cell->i;
+    if (cell->cell)
+    {
+        /* The object pointed to is still readable, and releasing it does
+           not free it */
+        destructed_sum += cell->cell->i;
+        release(cell->cell);
+    }
+}
+
+void test_shutdown_destructors(void)
+{
+    CU_ASSERT_FALSE(get_shutdown_destructors());
+
+    /* By default shutdown frees objects without running destructors */
+    struct cell *c = allocate(sizeof(struct cell), summing_destructor);
+    c->i = 1;
+    retain(c);
+    destructed_sum = 0;
+    shutdown();
+    CU_ASSERT_EQUAL(destructed_sum, 0);
+
+    set_shutdown_destructors(true);
+    CU_ASSERT_TRUE(get_shutdown_destructors());
+    c = allocate(sizeof(struct cell), summing_destructor);
+    c->i = 1;
+    retain(c);
+    c->cell = allocate(sizeof(struct cell), summing_destructor);
+    c->cell->i = 10;
+    retain(c->cell);
+    obj *scanned = allocate(sizeof(struct cell), NULL);
+    retain(scanned);
+    shutdown();
+    /* Both destructors ran once, and c's read its cell before it was freed */
+    CU_ASSERT_EQUAL(destructed_sum, 1 + 10 + 10);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* retain and release work again after shutdown */
+    c = allocate(sizeof(struct cell), NULL);
+    retain(c);
+    CU_ASSERT_EQUAL(rc(c), 1);
+    set_shutdown_destructors(false);
+    shutdown();
+}
+
+void test_shutdown_threads(void)
+{
+    CU_ASSERT_EQUAL(get_shutdown_threads(), 1);
+    set_shutdown_threads(0);
+    CU_ASSERT_EQUAL(get_shutdown_threads(), 1);
+
+    set_shutdown_threads(4);
+    CU_ASSERT_EQUAL(get_shutdown_threads(), 4);
+    /* Too few objects to split up */
+    for (int i = 0; i < 100; i++)
+    {
+        retain(allocate(16, NULL));
+    }
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* Enough objects for three threads, which must free all of them */
+    size_t limit = get_cascade_limit();
+    set_cascade_limit(0);
+    for (int i = 0; i < 3 * 4096 + 5; i++)
+    {
+        allocate(i % 64, NULL);
+    }
+    set_cascade_limit(limit);
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+    set_shutdown_threads(1);
+}
+
+static atomic_int slow_stage = 0;
+static bool slow_saw_owner = false;
+
+/// @brief Waits up to two seconds for the owner to retain and release
+///        another object while it runs
+static void slow_destructor(obj *object)
+{
+    atomic_store(&slow_stage, 1);
+    for (int i = 0; i < 2000 && atomic_load(&slow_stage) == 1; i++)
+    {
+        usleep(1000);
+    }
+    slow_saw_owner = atomic_load(&slow_stage) == 2;
+}
+
+void test_collector(void)
+{
+    CU_ASSERT_FALSE(refmem_collector_running());
+    CU_ASSERT_TRUE(refmem_collector_start(SIZE_MAX));
+    CU_ASSERT_FALSE(refmem_collector_start(SIZE_MAX));
+    CU_ASSERT_TRUE(refmem_collector_running());
+
+    /* The collector runs the destructors of the cell and the cell it
+       releases, stopping waits for both */
+    destructed_sum = 0;
+    struct cell *c = allocate(sizeof(struct cell), summing_destructor);
+    c->i = 1;
+    retain(c);
+    c->cell = allocate(sizeof(struct cell), summing_destructor);
+    c->cell->i = 10;
+    retain(c->cell);
+    release(c);
+    refmem_collector_stop();
+    CU_ASSERT_FALSE(refmem_collector_running());
+    CU_ASSERT_EQUAL(destructed_sum, 1 + 10 + 10);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+    CU_ASSERT_EQUAL(refmem_collector_queued_bytes(), 0);
+
+    /* The collector runs destructors without the heap lock, so the owner's
+       retain and release do not wait for them */
+    CU_ASSERT_TRUE(refmem_collector_start(SIZE_MAX));
+    obj *other = allocate(16, NULL);
+    retain(other);
+    obj *slow = allocate(16, slow_destructor);
+    retain(slow);
+    release(slow);
+    while (atomic_load(&slow_stage) == 0)
+    {
+        sched_yield();
+    }
+    retain(other);
+    release(other);
+    atomic_store(&slow_stage, 2);
+    refmem_collector_stop();
+    CU_ASSERT_TRUE(slow_saw_owner);
+    release(other);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* With no room in the queue, release frees the object itself */
+    CU_ASSERT_TRUE(refmem_collector_start(0));
+    obj *object = allocate(16, NULL);
+    retain(object);
+    release(object);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* shutdown stops the collector */
+    retain(allocate(16, NULL));
+    shutdown();
+    CU_ASSERT_FALSE(refmem_collector_running());
+}
+
+static void *release_on_thread(void *object)
+{
+    refmem_release_remote(object);
+    return NULL;
+}
+
+void test_release_remote(void)
+{
+    CU_ASSERT_EQUAL(refmem_drain_remote(), 0);
+
+    obj *first = allocate(16, NULL);
+    retain(first);
+    obj *second = allocate(16, NULL);
+    retain(second);
+    pthread_t thread;
+    pthread_create(&thread, NULL, release_on_thread, first);
+    pthread_join(thread, NULL);
+    pthread_create(&thread, NULL, release_on_thread, second);
+    pthread_join(thread, NULL);
+
+    /* Nothing happens until the owner drains the queue */
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+    CU_ASSERT_EQUAL(refmem_drain_remote(), 2);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* allocate drains it too */
+    obj *object = allocate(16, NULL);
+    retain(object);
+    CU_ASSERT_TRUE(refmem_release_remote(object));
+    CU_ASSERT_EQUAL(rc(object), 1);
+    retain(allocate(16, NULL));
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    /* Releases of one object are counted in it, which is queued once */
+    obj *shared = allocate_owned(16, NULL);
+    retain(shared);
+    retain(shared);
+    for (int i = 0; i < 3; i++)
+    {
+        pthread_create(&thread, NULL, release_on_thread, shared);
+        pthread_join(thread, NULL);
+    }
+    CU_ASSERT_EQUAL(rc(shared), 3);
+    CU_ASSERT_EQUAL(refmem_drain_remote(), 3);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    /* An object is not freed while a release of it waits in the queue */
+    obj *garbage = allocate(16, NULL);
+    CU_ASSERT_TRUE(refmem_release_remote(garbage));
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+    CU_ASSERT_EQUAL(refmem_drain_remote(), 1);
+    CU_ASSERT_EQUAL(refmem_object_count(), 1);
+
+    /* shutdown drops releases that were not drained */
+    refmem_release_remote(allocate(16, NULL));
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_drain_remote(), 0);
+}
+
+void test_freeze(void)
+{
+    obj *live = allocate(16, NULL);
+    retain(live);
+    obj *garbage = allocate(16, NULL);
+    CU_ASSERT_EQUAL(refmem_freeze(), 2);
+
+    /* Frozen objects keep their counts and are never freed */
+    retain(live);
+    CU_ASSERT_EQUAL(rc(live), 1);
+    release(live);
+    release(live);
+    CU_ASSERT_EQUAL(rc(live), 1);
+    cleanup();
+    deallocate(garbage);
+    CU_ASSERT_EQUAL(refmem_object_count(), 2);
+
+    /* Objects allocated later are counted as usual until the next freeze */
+    obj *later = allocate(16, NULL);
+    retain(later);
+    retain(later);
+    CU_ASSERT_EQUAL(rc(later), 2);
+    release(later);
+    CU_ASSERT_EQUAL(refmem_freeze(), 1);
+    release(later);
+    CU_ASSERT_EQUAL(rc(later), 1);
+
+    /* shutdown frees them */
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+}
+
+static atomic_bool reader_entered = false;
+static atomic_bool reader_may_exit = false;
+
+static void *read_on_thread(void *extra)
+{
+    refmem_epoch_enter();
+    atomic_store(&reader_entered, true);
+    while (!atomic_load(&reader_may_exit))
+    {
+        sched_yield();
+    }
+    refmem_epoch_exit();
+    return NULL;
+}
+
+void test_epochs(void)
+{
+    obj *object = allocate(16, NULL);
+    retain(object);
+    CU_ASSERT_TRUE(refmem_epoch_enter());
+    CU_ASSERT_TRUE(refmem_epoch_enter());
+    refmem_epoch_release(object);
+    CU_ASSERT_EQUAL(refmem_epoch_pending(), 1);
+
+    /* This thread entered before the release, so it holds it back until it
+       has left both sections */
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 0);
+    refmem_epoch_exit();
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 0);
+    CU_ASSERT_EQUAL(rc(object), 1);
+    refmem_epoch_exit();
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 1);
+    CU_ASSERT_EQUAL(refmem_epoch_pending(), 0);
+    CU_ASSERT_EQUAL(refmem_object_count(), 0);
+
+    /* A reader that enters after the release does not hold it back */
+    object = allocate(16, NULL);
+    retain(object);
+    refmem_epoch_release(object);
+    refmem_epoch_enter();
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 1);
+    refmem_epoch_exit();
+
+    /* Nor do readers on other threads, until they exit */
+    object = allocate(16, NULL);
+    retain(object);
+    pthread_t thread;
+    pthread_create(&thread, NULL, read_on_thread, NULL);
+    while (!atomic_load(&reader_entered))
+    {
+        sched_yield();
+    }
+    refmem_epoch_release(object);
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 0);
+    atomic_store(&reader_may_exit, true);
+    pthread_join(thread, NULL);
+    CU_ASSERT_EQUAL(refmem_epoch_reclaim(), 1);
+
+    /* shutdown drops releases that are held back */
+    retain(allocate(16, NULL));
+    object = allocate(16, NULL);
+    retain(object);
+    refmem_epoch_enter();
+    refmem_epoch_release(object);
+    refmem_epoch_exit();
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_epoch_pending(), 0);
+}
+
 void cascade_test(void)
 {
     struct cell *c = allocate(sizeof(struct cell), cell_destructor);
@@ -405,7 +1220,10 @@ void test_get_struct_index(void)
     CU_ASSERT_EQUAL(index, 1);
 
     release(object_1);
+#if !defined(REFMEM_CHECKED) && !defined(REFMEM_FAST)
+    // Releasing a freed object does nothing, unless it is checked or trusted
     release(object_1);
+#endif
 
     CU_ASSERT_TRUE(get_struct_index(object_2, &index));
     CU_ASSERT_EQUAL(index, 0);
@@ -459,8 +1277,10 @@ void test_get_struct(void)
     release(object_2);
     release(object_2);
 
+#ifndef REFMEM_FAST
     // object 1 has been deleted so get_struct should return NULL
     CU_ASSERT_PTR_NULL(get_struct(object_1));
+#endif
 
     struct2 = get_struct(object_2);
     CU_ASSERT_EQUAL(struct2->destructor, default_destructor);
@@ -470,14 +1290,18 @@ void test_get_struct(void)
 
     release(object_2);
 
+#ifndef REFMEM_FAST
     // object 2 has now also been deleted
     CU_ASSERT_PTR_NULL(get_struct(object_1));
     CU_ASSERT_PTR_NULL(get_struct(object_2));
+#endif
 
     release(object_3);
     release(object_3);
 
+#ifndef REFMEM_FAST
     CU_ASSERT_PTR_NULL(get_struct(object_3));
+#endif
 
     shutdown();
 }
@@ -490,6 +1314,362 @@ void test_remove_ptr_list_null(void) {
     shutdown();
 }
 
+void test_pause_instrumentation(void)
+{
+    refmem_pause_reset();
+
+    struct cell *c = allocate(sizeof(struct cell), cell_destructor);
+    retain(c);
+    c->cell = allocate(sizeof(struct cell), cell_destructor);
+    retain(c->cell);
+
+    // An allocation that finds no garbage is not an episode
+    CU_ASSERT_EQUAL(refmem_pause_summary(REFMEM_PAUSE_KINDS).episodes, 0);
+
+    // Releasing c frees both cells in a single cascade
+    release(c);
+    refmem_pause_summary_t cascade = refmem_pause_summary(REFMEM_PAUSE_CASCADE);
+    CU_ASSERT_EQUAL(cascade.episodes, 1);
+    CU_ASSERT_EQUAL(cascade.objects_freed, 2);
+    CU_ASSERT_EQUAL(cascade.bytes_freed, 2 * sizeof(struct cell));
+    CU_ASSERT_TRUE(cascade.p50_ns <= cascade.p99_ns);
+    CU_ASSERT_TRUE(cascade.p99_ns <= cascade.max_ns);
+
+    // Unretained objects are reclaimed by cleanup()
+    allocate(4, NULL);
+    cleanup();
+    CU_ASSERT_EQUAL(refmem_pause_summary(REFMEM_PAUSE_CLEANUP).objects_freed, 1);
+
+    obj *kept = allocate(16, NULL);
+    retain(kept);
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_pause_summary(REFMEM_PAUSE_SHUTDOWN).bytes_freed, 16);
+
+    refmem_pause_t recent[8];
+    CU_ASSERT_EQUAL(refmem_pause_recent(recent, 8), 3);
+    CU_ASSERT_EQUAL(recent[0].kind, REFMEM_PAUSE_CASCADE);
+    CU_ASSERT_EQUAL(recent[1].kind, REFMEM_PAUSE_CLEANUP);
+    CU_ASSERT_EQUAL(recent[2].kind, REFMEM_PAUSE_SHUTDOWN);
+    CU_ASSERT_EQUAL(recent[2].objects_freed, 1);
+
+    // Only the newest episodes are copied when the buffer is small
+    CU_ASSERT_EQUAL(refmem_pause_recent(recent, 1), 1);
+    CU_ASSERT_EQUAL(recent[0].kind, REFMEM_PAUSE_SHUTDOWN);
+
+    CU_ASSERT_EQUAL(refmem_pause_summary(REFMEM_PAUSE_KINDS).episodes, 3);
+    refmem_pause_reset();
+    CU_ASSERT_EQUAL(refmem_pause_summary(REFMEM_PAUSE_KINDS).episodes, 0);
+    CU_ASSERT_EQUAL(refmem_pause_recent(recent, 8), 0);
+}
+
+void test_allocation_sites(void)
+{
+    static const char *file = "store.c";
+    // Built with REFMEM_TRACK_SITES, the other tests' allocations are sites too
+    refmem_sites_reset();
+
+    obj *small = allocate_ex_at(8, NULL, 0, 0, 0, file, 10, "merch_create");
+    retain(small);
+    obj *big = allocate_ex_at(4 * 64, NULL, 0, 0, 0, file, 20, "entry_create");
+    retain(big);
+    obj *again = allocate_ex_at(8, NULL, 0, 0, 0, file, 10, "merch_create");
+    retain(again);
+
+    refmem_site_t sites[4];
+    CU_ASSERT_EQUAL(refmem_sites(sites, 4), 2);
+    // Sorted by live bytes, largest first
+    CU_ASSERT_EQUAL(sites[0].line, 20);
+    CU_ASSERT_EQUAL(sites[0].live_bytes, 256);
+    CU_ASSERT_EQUAL(sites[1].line, 10);
+    CU_ASSERT_STRING_EQUAL(sites[1].func, "merch_create");
+    CU_ASSERT_EQUAL(sites[1].live_count, 2);
+    CU_ASSERT_EQUAL(sites[1].live_bytes, 16);
+
+    release(big);
+    release(small);
+    CU_ASSERT_EQUAL(refmem_sites(sites, 4), 2);
+    CU_ASSERT_EQUAL(sites[0].line, 10);
+    CU_ASSERT_EQUAL(sites[0].live_count, 1);
+    CU_ASSERT_EQUAL(sites[0].total_allocations, 2);
+    CU_ASSERT_EQUAL(sites[1].live_bytes, 0);
+    CU_ASSERT_EQUAL(sites[1].total_bytes, 256);
+
+    // Objects freed by shutdown are no longer live either
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_sites(sites, 1), 1);
+    CU_ASSERT_EQUAL(sites[0].live_count, 0);
+    CU_ASSERT_EQUAL(sites[0].live_bytes, 0);
+
+    // Overflowing arrays are not counted
+    CU_ASSERT_PTR_NULL(allocate_ex_at(refmem_array_size(SIZE_MAX, SIZE_MAX), NULL, 0, 0, 0, file, 30,
+                                      "test"));
+    CU_ASSERT_EQUAL(refmem_sites(sites, 4), 3);
+    shutdown();
+
+    refmem_sites_reset();
+    CU_ASSERT_EQUAL(refmem_sites(sites, 4), 0);
+}
+
+void test_sampling_profiler(void)
+{
+    CU_ASSERT_EQUAL(refmem_sample_get_interval(), 0);
+
+    // Sampling is off by default
+    obj *unsampled = allocate(64, NULL);
+    retain(unsampled);
+    CU_ASSERT_EQUAL(refmem_sample_live(), 0);
+
+    // With a mean of one byte between samples, 64 byte objects are always
+    // sampled and each sample stands for its own size
+    refmem_sample_set_interval(1);
+    CU_ASSERT_EQUAL(refmem_sample_get_interval(), 1);
+    obj *objects[3];
+    for (int i = 0; i < 3; i++)
+    {
+        objects[i] = allocate(64, NULL);
+        retain(objects[i]);
+    }
+    refmem_sample_set_interval(0);
+    CU_ASSERT_EQUAL(refmem_sample_live(), 3);
+
+    FILE *profile = tmpfile();
+    refmem_sample_write_folded(profile);
+    rewind(profile);
+    char line[4096];
+    size_t total = 0;
+    while (fgets(line, sizeof(line), profile))
+    {
+        char *bytes = strrchr(line, ' ');
+        CU_ASSERT_PTR_NOT_NULL(bytes);
+        total += bytes ? strtoul(bytes + 1, NULL, 10) : 0;
+    }
+    fclose(profile);
+    CU_ASSERT_EQUAL(total, 3 * 64);
+
+    // Freed objects leave the profile
+    release(objects[1]);
+    CU_ASSERT_EQUAL(refmem_sample_live(), 2);
+    shutdown();
+    CU_ASSERT_EQUAL(refmem_sample_live(), 0);
+}
+
+void test_dump_heap(void)
+{
+    struct cell *c = allocate(sizeof(struct cell), NULL);
+    retain(c);
+    c->cell = allocate(sizeof(struct cell), NULL);
+    retain(c->cell);
+
+    char path[] = "/tmp/refmem_dump_XXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE(fd >= 0);
+    close(fd);
+    CU_ASSERT_TRUE(refmem_dump_heap(path));
+
+    FILE *in = fopen(path, "rb");
+    unsigned char bytes[1024];
+    size_t length = fread(bytes, 1, sizeof(bytes), in);
+    fclose(in);
+    remove(path);
+
+    CU_ASSERT_TRUE(length > 8);
+    CU_ASSERT_EQUAL(memcmp(bytes, REFMEM_DUMP_MAGIC, 4), 0);
+    CU_ASSERT_EQUAL(bytes[4], REFMEM_DUMP_VERSION);
+    // The only destructor is named, and the dump ends with the object count
+    CU_ASSERT_EQUAL(bytes[5], REFMEM_DUMP_DESTRUCTOR);
+    CU_ASSERT_EQUAL(memcmp(bytes + 8, "default_destructor", 18), 0);
+    CU_ASSERT_EQUAL(bytes[length - 2], REFMEM_DUMP_END);
+    CU_ASSERT_EQUAL(bytes[length - 1], 2);
+
+    // Writing to a directory that does not exist fails
+    CU_ASSERT_FALSE(refmem_dump_heap("/nonexistent/refmem.dump"));
+
+    shutdown();
+}
+
+typedef struct hook_counts hook_counts_t;
+struct hook_counts
+{
+    size_t allocations;
+    size_t retains;
+    size_t releases;
+    size_t frees;
+    size_t episodes;
+    size_t last_rc;
+};
+
+static void count_allocate(obj *object, size_t bytes, void *user)
+{
+    ((hook_counts_t *)user)->allocations++;
+}
+
+static void count_retain(obj *object, size_t rc, void *user)
+{
+    ((hook_counts_t *)user)->retains++;
+    ((hook_counts_t *)user)->last_rc = rc;
+}
+
+static void count_release(obj *object, size_t rc, void *user)
+{
+    ((hook_counts_t *)user)->releases++;
+    ((hook_counts_t *)user)->last_rc = rc;
+}
+
+static void count_free(obj *object, size_t bytes, void *user)
+{
+    ((hook_counts_t *)user)->frees++;
+}
+
+static void count_episode(const refmem_pause_t *pause, void *user)
+{
+    ((hook_counts_t *)user)->episodes += pause->objects_freed > 0;
+}
+
+void test_hooks(void)
+{
+    hook_counts_t counts = {0};
+    refmem_hooks_t hooks = {
+        .on_allocate = count_allocate,
+        .on_retain = count_retain,
+        .on_release = count_release,
+        .on_free = count_free,
+        .on_cascade_end = count_episode,
+        .user = &counts,
+    };
+
+#ifdef REFMEM_HOOKS
+    CU_ASSERT_TRUE(refmem_set_hooks(&hooks));
+
+    struct cell *c = allocate(sizeof(struct cell), cell_destructor);
+    retain(c);
+    retain(c);
+    CU_ASSERT_EQUAL(counts.last_rc, 2);
+    c->cell = allocate(sizeof(struct cell), cell_destructor);
+    retain(c->cell);
+    release(c);
+    CU_ASSERT_EQUAL(counts.last_rc, 1);
+    release(c);
+
+    CU_ASSERT_EQUAL(counts.allocations, 2);
+    CU_ASSERT_EQUAL(counts.retains, 3);
+    // The second release of c releases its cell as well
+    CU_ASSERT_EQUAL(counts.releases, 3);
+    CU_ASSERT_EQUAL(counts.frees, 2);
+    CU_ASSERT_EQUAL(counts.episodes, 1);
+
+    // Removed hooks are no longer called
+    CU_ASSERT_TRUE(refmem_set_hooks(NULL));
+    retain(allocate(8, NULL));
+    CU_ASSERT_EQUAL(counts.allocations, 2);
+    shutdown();
+
+    FILE *trace = tmpfile();
+    CU_ASSERT_TRUE(refmem_chrome_trace_start(trace, true));
+    obj *o = allocate(8, NULL);
+    retain(o);
+    release(o);
+    refmem_chrome_trace_stop();
+
+    rewind(trace);
+    char json[4096];
+    size_t length = fread(json, 1, sizeof(json) - 1, trace);
+    json[length] = '\0';
+    fclose(trace);
+    CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"traceEvents\":["));
+    CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"cascade\",\"ph\":\"X\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"name\":\"retain\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(json, "\"refmem heap\""));
+    CU_ASSERT_PTR_NOT_NULL(strstr(json, "]}"));
+#else
+    // Without REFMEM_HOOKS there is nothing to call the hooks
+    CU_ASSERT_FALSE(refmem_set_hooks(&hooks));
+    CU_ASSERT_FALSE(refmem_chrome_trace_start(stderr, false));
+#endif
+    shutdown();
+}
+
+void test_record_trace(void)
+{
+    // Objects from before the recording are left out
+    obj *old = allocate(8, NULL);
+    retain(old);
+
+    char path[] = "/tmp/refmem_trace_XXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE(fd >= 0);
+    close(fd);
+    CU_ASSERT_TRUE(refmem_record_start(path));
+    CU_ASSERT_FALSE(refmem_record_start(path));
+
+    retain(old);
+    struct cell *c = allocate(sizeof(struct cell), cell_destructor);
+    retain(c);
+    c->cell = allocate(sizeof(struct cell), cell_destructor);
+    retain(c->cell);
+    release(c);
+    set_cascade_limit(SIZE_MAX);
+    cleanup();
+    CU_ASSERT_TRUE(refmem_record_stop());
+    CU_ASSERT_FALSE(refmem_record_stop());
+
+    FILE *in = fopen(path, "rb");
+    unsigned char bytes[64];
+    size_t length = fread(bytes, 1, sizeof(bytes), in);
+    fclose(in);
+    remove(path);
+
+    // Objects are referred to by how many objects were allocated after them
+    const unsigned char expected[] = {
+        'R', 'M', 'T', 'R', REFMEM_TRACE_VERSION,
+        REFMEM_TRACE_ALLOCATE, sizeof(struct cell),
+        REFMEM_TRACE_RETAIN, 0,
+        REFMEM_TRACE_ALLOCATE, sizeof(struct cell),
+        REFMEM_TRACE_RETAIN, 0,
+        REFMEM_TRACE_RELEASE, 1,
+        // The release in c's destructor is recorded as part of destroying c
+        REFMEM_TRACE_DESTROY, 1,
+        REFMEM_TRACE_RELEASE, 0,
+        REFMEM_TRACE_DESTROY, 0,
+        REFMEM_TRACE_DESTROYED,
+        REFMEM_TRACE_DESTROYED,
+        REFMEM_TRACE_LIMIT, 0,
+        REFMEM_TRACE_CLEANUP,
+        REFMEM_TRACE_END, 2};
+    CU_ASSERT_EQUAL(length, sizeof(expected));
+    CU_ASSERT_EQUAL(memcmp(bytes, expected, sizeof(expected)), 0);
+
+    shutdown();
+}
+
+void test_record_replay(void)
+{
+    char path[] = "/tmp/refmem_trace_XXXXXX";
+    int fd = mkstemp(path);
+    CU_ASSERT_TRUE(fd >= 0);
+    close(fd);
+    CU_ASSERT_TRUE(refmem_record_start(path));
+
+    // release_many frees a, b and c only after every count has dropped
+    struct cell *a = allocate(sizeof(struct cell), cell_destructor);
+    retain(a);
+    a->cell = allocate(sizeof(struct cell), cell_destructor);
+    retain(a->cell);
+    struct cell *c = allocate(sizeof(struct cell), cell_destructor);
+    c->cell = NULL;
+    obj *objects[] = {a, c, a};
+    retain_many(objects + 1, 2);
+    release_many(objects, 3);
+    cleanup();
+    CU_ASSERT_TRUE(refmem_record_stop());
+
+    char command[64];
+    snprintf(command, sizeof(command), "./refmem_replay %s > /dev/null", path);
+    CU_ASSERT_EQUAL(system(command), 0);
+    remove(path);
+
+    shutdown();
+}
+
 int main(void)
 {
     // First we try to set up CUnit, and exit if we fail
@@ -516,12 +1696,31 @@ int main(void)
     if (
         !CU_add_test(my_test_suite, "Set and get the cascade limit", test_set_get_cascade_limit)
         || !CU_add_test(my_test_suite, "Test allocate_array", test_allocate_array)
+        || !CU_add_test(my_test_suite, "Test allocate_owned", test_allocate_owned)
+        || !CU_add_test(my_test_suite, "Test refmem_move", test_refmem_move)
+        || !CU_add_test(my_test_suite, "Test retain_many and release_many", test_retain_release_many)
+        || !CU_add_test(my_test_suite, "Test allocate_uninit", test_allocate_uninit)
+        || !CU_add_test(my_test_suite, "Test reallocate", test_reallocate)
+        || !CU_add_test(my_test_suite, "Test allocate_aligned", test_allocate_aligned)
+        || !CU_add_test(my_test_suite, "Test allocate_with_trailer", test_allocate_with_trailer)
+        || !CU_add_test(my_test_suite, "Test REFMEM_DEFINE_TYPE", test_define_type)
+        || !CU_add_test(my_test_suite, "Test retain_inline and release_inline", test_retain_release_inline)
+#ifdef REFMEM_CHECKED
+        || !CU_add_test(my_test_suite, "Test REFMEM_CHECKED", test_checked)
+#endif
+        || !CU_add_test(my_test_suite, "Test ref_vec", test_ref_vec)
         || !CU_add_test(my_test_suite, "test allocation of memory", test_allocate_deallocate)
         || !CU_add_test(my_test_suite, "test rc()", test_rc)
         || !CU_add_test(my_test_suite, "Test retain", test_retain)
         || !CU_add_test(my_test_suite, "Test release", test_release)
         || !CU_add_test(my_test_suite, "Test cleanup", test_cleanup)
         || !CU_add_test(my_test_suite, "Test shutdown", test_shutdown)
+        || !CU_add_test(my_test_suite, "Test destructors on shutdown", test_shutdown_destructors)
+        || !CU_add_test(my_test_suite, "Test shutdown on several threads", test_shutdown_threads)
+        || !CU_add_test(my_test_suite, "Test the collector thread", test_collector)
+        || !CU_add_test(my_test_suite, "Test releasing from other threads", test_release_remote)
+        || !CU_add_test(my_test_suite, "Test epoch-based reclamation", test_epochs)
+        || !CU_add_test(my_test_suite, "Test freezing the heap", test_freeze)
         || !CU_add_test(my_test_suite, "Test cascade respect", cascade_test)
         || !CU_add_test(my_test_suite, "Test cascade_limit variable", test_cascade_limit_variable)
         || !CU_add_test(my_test_suite, "Test equaltiy function", test_eq_func)
@@ -529,6 +1728,13 @@ int main(void)
         || !CU_add_test(my_test_suite, "Test get struct", test_get_struct)
         || !CU_add_test(my_test_suite, "Test default destructor", test_default_destructor)
         || !CU_add_test(my_test_suite, "Test remove ptr from null ptr_list", test_remove_ptr_list_null)
+        || !CU_add_test(my_test_suite, "Test pause instrumentation", test_pause_instrumentation)
+        || !CU_add_test(my_test_suite, "Test allocation sites", test_allocation_sites)
+        || !CU_add_test(my_test_suite, "Test sampling heap profiler", test_sampling_profiler)
+        || !CU_add_test(my_test_suite, "Test heap dump", test_dump_heap)
+        || !CU_add_test(my_test_suite, "Test event hooks", test_hooks)
+        || !CU_add_test(my_test_suite, "Test recording a trace", test_record_trace)
+        || !CU_add_test(my_test_suite, "Test replaying a recorded trace", test_record_replay)
     ) {
         // If adding any of the tests fails, we tear down CUnit and exit
         CU_cleanup_registry();
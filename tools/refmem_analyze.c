@@ -0,0 +1,597 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/refmem_dump.h"
+
+/**
+ * @file refmem_analyze.c
+ * @brief Offline analysis of heap snapshots written by refmem_dump_heap.
+ *
+ * Objects whose reference count is larger than the number of references from
+ * other objects in the snapshot are held from outside the heap (stack,
+ * globals) and become roots. Objects that are only reachable through a cycle
+ * of references are leaked; they are reported and then treated as roots too.
+ *
+ * The dominator tree is computed with the iterative algorithm of Cooper,
+ * Harvey and Kennedy. The retained size of an object is the size of all
+ * objects it dominates, i.e. what would be freed if it was released.
+ *
+ * Usage: refmem_analyze [-n rows] [-d depth] dump-file
+ */
+
+typedef struct node node_t;
+struct node
+{
+    uint64_t address;
+    uint64_t size;
+    uint64_t rc;
+    uint64_t destructor;
+    size_t first_edge;
+    size_t edge_count;
+    size_t indegree;
+    bool is_root;
+    bool leaked;
+};
+
+typedef struct heap heap_t;
+struct heap
+{
+    node_t *nodes;
+    size_t count;
+    /// @brief Edge targets as addresses while reading, node indices after
+    uint64_t *edges;
+    size_t edge_count;
+    char **destructors;
+    size_t destructor_count;
+};
+
+static bool read_varint(FILE *in, uint64_t *value)
+{
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = fgetc(in);
+        if (byte == EOF)
+        {
+            return false;
+        }
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void *grow_array(void *array, size_t *capacity, size_t needed, size_t elem_size)
+{
+    if (needed <= *capacity)
+    {
+        return array;
+    }
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    while (new_capacity < needed)
+    {
+        new_capacity *= 2;
+    }
+    void *grown = realloc(array, new_capacity * elem_size);
+    if (!grown)
+    {
+        fprintf(stderr, "refmem_analyze: out of memory\n");
+        exit(1);
+    }
+    *capacity = new_capacity;
+    return grown;
+}
+
+static bool read_destructor(FILE *in, heap_t *heap, size_t *capacity)
+{
+    uint64_t id, length;
+    if (!read_varint(in, &id) || !read_varint(in, &length) || id != heap->destructor_count)
+    {
+        return false;
+    }
+    char *name = malloc(length + 1);
+    if (!name || fread(name, 1, length, in) != length)
+    {
+        free(name);
+        return false;
+    }
+    name[length] = '\0';
+    heap->destructors = grow_array(heap->destructors, capacity, id + 1, sizeof(char *));
+    heap->destructors[heap->destructor_count++] = name;
+    return true;
+}
+
+static bool read_object(FILE *in, heap_t *heap, size_t *capacity, size_t *edge_capacity)
+{
+    node_t node = {0};
+    uint64_t edge_count;
+    if (!read_varint(in, &node.address) || !read_varint(in, &node.size) ||
+        !read_varint(in, &node.rc) || !read_varint(in, &node.destructor) ||
+        !read_varint(in, &edge_count) || node.destructor >= heap->destructor_count)
+    {
+        return false;
+    }
+    node.first_edge = heap->edge_count;
+    node.edge_count = edge_count;
+    heap->edges = grow_array(heap->edges, edge_capacity, heap->edge_count + edge_count, sizeof(uint64_t));
+    for (uint64_t i = 0; i < edge_count; i++)
+    {
+        if (!read_varint(in, &heap->edges[heap->edge_count++]))
+        {
+            return false;
+        }
+    }
+    heap->nodes = grow_array(heap->nodes, capacity, heap->count + 1, sizeof(node_t));
+    heap->nodes[heap->count++] = node;
+    return true;
+}
+
+static bool read_dump(const char *path, heap_t *heap)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        perror(path);
+        return false;
+    }
+
+    char magic[4];
+    uint64_t version;
+    if (fread(magic, 1, 4, in) != 4 || memcmp(magic, REFMEM_DUMP_MAGIC, 4) != 0 ||
+        !read_varint(in, &version) || version != REFMEM_DUMP_VERSION)
+    {
+        fprintf(stderr, "%s: not a refmem heap dump (version %d)\n", path, REFMEM_DUMP_VERSION);
+        fclose(in);
+        return false;
+    }
+
+    size_t capacity = 0, edge_capacity = 0, destructor_capacity = 0;
+    bool ok = true;
+    for (int tag = fgetc(in); ok; tag = fgetc(in))
+    {
+        if (tag == REFMEM_DUMP_DESTRUCTOR)
+        {
+            ok = read_destructor(in, heap, &destructor_capacity);
+        }
+        else if (tag == REFMEM_DUMP_OBJECT)
+        {
+            ok = read_object(in, heap, &capacity, &edge_capacity);
+        }
+        else if (tag == REFMEM_DUMP_END)
+        {
+            uint64_t count;
+            ok = read_varint(in, &count) && count == heap->count;
+            break;
+        }
+        else
+        {
+            ok = false;
+        }
+    }
+    fclose(in);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: truncated or corrupt heap dump\n", path);
+    }
+    return ok;
+}
+
+static int compare_by_address(const void *a, const void *b)
+{
+    const node_t *x = a;
+    const node_t *y = b;
+    return x->address < y->address ? -1 : x->address > y->address;
+}
+
+/// @brief Sort the nodes by address and turn edge addresses into node indices
+static void resolve_edges(heap_t *heap)
+{
+    /* Edges refer to addresses, so they survive the nodes being reordered */
+    qsort(heap->nodes, heap->count, sizeof(node_t), compare_by_address);
+    for (size_t i = 0; i < heap->edge_count; i++)
+    {
+        node_t key = {.address = heap->edges[i]};
+        node_t *target = bsearch(&key, heap->nodes, heap->count, sizeof(node_t), compare_by_address);
+        heap->edges[i] = target ? (uint64_t)(target - heap->nodes) : SIZE_MAX;
+    }
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        node_t *node = &heap->nodes[i];
+        for (size_t e = node->first_edge; e < node->first_edge + node->edge_count; e++)
+        {
+            if (heap->edges[e] != SIZE_MAX)
+            {
+                heap->nodes[heap->edges[e]].indegree++;
+            }
+        }
+    }
+}
+
+typedef struct graph graph_t;
+struct graph
+{
+    heap_t *heap;
+    /// @brief Index of the virtual root, which points to all roots
+    size_t root;
+    size_t *postorder;
+    size_t *order;  // nodes in reverse postorder
+    size_t ordered;
+    size_t *idom;
+    /// @brief Predecessors in compressed sparse row form
+    size_t *pred_start;
+    size_t *preds;
+};
+
+static size_t successor_count(graph_t *g, size_t v)
+{
+    return v == g->root ? g->heap->count : g->heap->nodes[v].edge_count;
+}
+
+/// @brief The i:th successor of v, or SIZE_MAX if there is none
+static size_t successor(graph_t *g, size_t v, size_t i)
+{
+    if (v == g->root)
+    {
+        return g->heap->nodes[i].is_root ? i : SIZE_MAX;
+    }
+    return g->heap->edges[g->heap->nodes[v].first_edge + i];
+}
+
+/// @brief Depth first search from the root, numbering nodes in postorder
+static void depth_first(graph_t *g, bool *visited, size_t *next_number, size_t *postorder_nodes)
+{
+    size_t n = g->heap->count + 1;
+    size_t *stack = malloc(n * sizeof(size_t));
+    size_t *next_child = calloc(n, sizeof(size_t));
+    size_t depth = 0;
+
+    if (!visited[g->root])
+    {
+        visited[g->root] = true;
+        stack[depth++] = g->root;
+    }
+    while (depth > 0)
+    {
+        size_t v = stack[depth - 1];
+        if (next_child[v] < successor_count(g, v))
+        {
+            size_t w = successor(g, v, next_child[v]++);
+            if (w != SIZE_MAX && !visited[w])
+            {
+                visited[w] = true;
+                stack[depth++] = w;
+            }
+        }
+        else
+        {
+            depth--;
+            g->postorder[v] = *next_number;
+            postorder_nodes[(*next_number)++] = v;
+        }
+    }
+    free(stack);
+    free(next_child);
+}
+
+/// @brief Find the nodes that are held from outside the heap, or only by cycles
+static void find_roots(graph_t *g)
+{
+    heap_t *heap = g->heap;
+    size_t n = heap->count + 1;
+    bool *visited = calloc(n, sizeof(bool));
+    size_t *postorder_nodes = malloc(n * sizeof(size_t));
+    size_t next_number = 0;
+
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        node_t *node = &heap->nodes[i];
+        node->is_root = node->rc > node->indegree || node->rc == 0;
+    }
+    depth_first(g, visited, &next_number, postorder_nodes);
+
+    /* Whatever is not reachable now is kept alive by reference cycles only */
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        if (!visited[i])
+        {
+            heap->nodes[i].is_root = true;
+            heap->nodes[i].leaked = true;
+        }
+    }
+    memset(visited, 0, n * sizeof(bool));
+    next_number = 0;
+    depth_first(g, visited, &next_number, postorder_nodes);
+
+    g->ordered = next_number;
+    for (size_t i = 0; i < next_number; i++)
+    {
+        g->order[i] = postorder_nodes[next_number - 1 - i];
+    }
+    free(visited);
+    free(postorder_nodes);
+}
+
+static void build_predecessors(graph_t *g)
+{
+    size_t n = g->heap->count + 1;
+    g->pred_start = calloc(n + 1, sizeof(size_t));
+    for (size_t v = 0; v < n; v++)
+    {
+        for (size_t i = 0; i < successor_count(g, v); i++)
+        {
+            size_t w = successor(g, v, i);
+            if (w != SIZE_MAX)
+            {
+                g->pred_start[w + 1]++;
+            }
+        }
+    }
+    for (size_t v = 0; v < n; v++)
+    {
+        g->pred_start[v + 1] += g->pred_start[v];
+    }
+    g->preds = malloc((g->pred_start[n] + 1) * sizeof(size_t));
+    size_t *fill = malloc(n * sizeof(size_t));
+    memcpy(fill, g->pred_start, n * sizeof(size_t));
+    for (size_t v = 0; v < n; v++)
+    {
+        for (size_t i = 0; i < successor_count(g, v); i++)
+        {
+            size_t w = successor(g, v, i);
+            if (w != SIZE_MAX)
+            {
+                g->preds[fill[w]++] = v;
+            }
+        }
+    }
+    free(fill);
+}
+
+static size_t intersect(graph_t *g, size_t a, size_t b)
+{
+    while (a != b)
+    {
+        while (g->postorder[a] < g->postorder[b])
+        {
+            a = g->idom[a];
+        }
+        while (g->postorder[b] < g->postorder[a])
+        {
+            b = g->idom[b];
+        }
+    }
+    return a;
+}
+
+static void compute_dominators(graph_t *g)
+{
+    size_t n = g->heap->count + 1;
+    for (size_t v = 0; v < n; v++)
+    {
+        g->idom[v] = SIZE_MAX;
+    }
+    g->idom[g->root] = g->root;
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (size_t i = 1; i < g->ordered; i++)
+        {
+            size_t v = g->order[i];
+            size_t new_idom = SIZE_MAX;
+            for (size_t p = g->pred_start[v]; p < g->pred_start[v + 1]; p++)
+            {
+                size_t pred = g->preds[p];
+                if (g->idom[pred] == SIZE_MAX)
+                {
+                    continue;
+                }
+                new_idom = new_idom == SIZE_MAX ? pred : intersect(g, pred, new_idom);
+            }
+            if (g->idom[v] != new_idom)
+            {
+                g->idom[v] = new_idom;
+                changed = true;
+            }
+        }
+    }
+}
+
+// What compare_by_key sorts node indices by, largest first
+static const uint64_t *sort_keys;
+
+static int compare_by_key(const void *a, const void *b)
+{
+    uint64_t x = sort_keys[*(const size_t *)a];
+    uint64_t y = sort_keys[*(const size_t *)b];
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static void print_node(heap_t *heap, size_t v, const uint64_t *retained, int indent)
+{
+    node_t *node = &heap->nodes[v];
+    printf("%*s0x%012llx size=%llu retained=%llu rc=%llu %s%s\n", indent, "",
+           (unsigned long long)node->address,
+           (unsigned long long)node->size,
+           (unsigned long long)retained[v],
+           (unsigned long long)node->rc,
+           heap->destructors[node->destructor],
+           node->leaked ? " (leaked cycle)" : "");
+}
+
+static void print_tree(graph_t *g, size_t v, const uint64_t *retained, size_t **children,
+                       size_t *child_count, size_t rows, int depth, int max_depth)
+{
+    sort_keys = retained;
+    qsort(children[v], child_count[v], sizeof(size_t), compare_by_key);
+    for (size_t i = 0; i < child_count[v] && i < rows; i++)
+    {
+        size_t child = children[v][i];
+        print_node(g->heap, child, retained, 2 * depth);
+        if (depth + 1 < max_depth)
+        {
+            print_tree(g, child, retained, children, child_count, rows, depth + 1, max_depth);
+        }
+    }
+    if (child_count[v] > rows)
+    {
+        printf("%*s... %zu more\n", 2 * depth, "", child_count[v] - rows);
+    }
+}
+
+static void report(graph_t *g, size_t rows, int max_depth)
+{
+    heap_t *heap = g->heap;
+    size_t n = heap->count + 1;
+    uint64_t *retained = calloc(n, sizeof(uint64_t));
+    uint64_t *rcs = calloc(n, sizeof(uint64_t));
+
+    /* Children come after their dominator in reverse postorder */
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        retained[i] = heap->nodes[i].size;
+        rcs[i] = heap->nodes[i].rc;
+    }
+    for (size_t i = g->ordered; i-- > 1;)
+    {
+        size_t v = g->order[i];
+        retained[g->idom[v]] += retained[v];
+    }
+
+    uint64_t total = 0, leaked = 0, leaked_bytes = 0, roots = 0;
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        total += heap->nodes[i].size;
+        roots += g->idom[i] == g->root;
+        leaked += heap->nodes[i].leaked;
+        leaked_bytes += heap->nodes[i].leaked ? heap->nodes[i].size : 0;
+    }
+    printf("objects: %zu  bytes: %llu  edges: %zu  dominator roots: %llu\n",
+           heap->count, (unsigned long long)total, heap->edge_count, (unsigned long long)roots);
+    printf("only reachable through cycles: %llu objects, %llu bytes\n\n",
+           (unsigned long long)leaked, (unsigned long long)leaked_bytes);
+
+    size_t *ranked = malloc((heap->count + 1) * sizeof(size_t));
+    for (size_t i = 0; i < heap->count; i++)
+    {
+        ranked[i] = i;
+    }
+
+    printf("largest retained sizes:\n");
+    sort_keys = retained;
+    qsort(ranked, heap->count, sizeof(size_t), compare_by_key);
+    for (size_t i = 0; i < heap->count && i < rows; i++)
+    {
+        print_node(heap, ranked[i], retained, 2);
+    }
+
+    printf("\nlargest reference counts:\n");
+    sort_keys = rcs;
+    qsort(ranked, heap->count, sizeof(size_t), compare_by_key);
+    for (size_t i = 0; i < heap->count && i < rows; i++)
+    {
+        print_node(heap, ranked[i], retained, 2);
+    }
+
+    /* Dominator tree, children grouped per dominator */
+    size_t *child_count = calloc(n, sizeof(size_t));
+    size_t **children = calloc(n, sizeof(size_t *));
+    for (size_t v = 0; v < heap->count; v++)
+    {
+        if (g->idom[v] != SIZE_MAX)
+        {
+            child_count[g->idom[v]]++;
+        }
+    }
+    for (size_t v = 0; v < n; v++)
+    {
+        children[v] = malloc((child_count[v] + 1) * sizeof(size_t));
+        child_count[v] = 0;
+    }
+    for (size_t v = 0; v < heap->count; v++)
+    {
+        if (g->idom[v] != SIZE_MAX)
+        {
+            size_t d = g->idom[v];
+            children[d][child_count[d]++] = v;
+        }
+    }
+    printf("\ndominator tree:\n");
+    print_tree(g, g->root, retained, children, child_count, rows, 1, max_depth + 1);
+
+    for (size_t v = 0; v < n; v++)
+    {
+        free(children[v]);
+    }
+    free(children);
+    free(child_count);
+    free(ranked);
+    free(retained);
+    free(rcs);
+}
+
+int main(int argc, char *argv[])
+{
+    size_t rows = 10;
+    int max_depth = 3;
+    const char *path = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            rows = strtoul(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+        {
+            max_depth = atoi(argv[++i]);
+        }
+        else
+        {
+            path = argv[i];
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr, "usage: %s [-n rows] [-d depth] dump-file\n", argv[0]);
+        return 2;
+    }
+
+    heap_t heap = {0};
+    if (!read_dump(path, &heap))
+    {
+        return 1;
+    }
+    resolve_edges(&heap);
+
+    size_t n = heap.count + 1;
+    graph_t g = {.heap = &heap, .root = heap.count};
+    g.postorder = calloc(n, sizeof(size_t));
+    g.order = calloc(n, sizeof(size_t));
+    g.idom = calloc(n, sizeof(size_t));
+    find_roots(&g);
+    build_predecessors(&g);
+    compute_dominators(&g);
+    report(&g, rows, max_depth);
+
+    for (size_t i = 0; i < heap.destructor_count; i++)
+    {
+        free(heap.destructors[i]);
+    }
+    free(heap.destructors);
+    free(heap.nodes);
+    free(heap.edges);
+    free(g.postorder);
+    free(g.order);
+    free(g.idom);
+    free(g.pred_start);
+    free(g.preds);
+    return 0;
+}
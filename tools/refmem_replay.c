@@ -0,0 +1,302 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#include "../src/refmem.h"
+#include "../src/refmem_internal.h"
+#include "../src/refmem_pause.h"
+#include "../src/refmem_record.h"
+
+/**
+ * @file refmem_replay.c
+ * @brief Replay a trace written by refmem_record_start against this build of
+ * refmem, and report throughput, peak RSS and reclamation pauses.
+ *
+ * Every object is allocated with a destructor that plays back the calls the
+ * original destructor made, so cascades free the same objects in the same
+ * order. If refmem frees an object at a different point than it did while
+ * recording, the replay stops and reports where the runs diverged.
+ *
+ * Usage: refmem_replay trace-file
+ */
+
+typedef struct replay replay_t;
+struct replay
+{
+    const unsigned char *data;
+    size_t length;
+    size_t position;
+    /// @brief The objects of this run, indexed by their number in the trace
+    obj **objects;
+    size_t allocated;
+    size_t capacity;
+    uint64_t calls;
+};
+
+static replay_t replay;
+
+static void fail(const char *message)
+{
+    fprintf(stderr, "refmem_replay: %s at byte %zu of the trace\n", message, replay.position);
+    exit(1);
+}
+
+static uint64_t read_varint(void)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (replay.position >= replay.length)
+        {
+            fail("unexpected end of trace");
+        }
+        unsigned char byte = replay.data[replay.position++];
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+        {
+            return value;
+        }
+    }
+    fail("malformed number");
+    return 0;
+}
+
+static size_t read_number(void)
+{
+    uint64_t distance = read_varint();
+    if (distance >= replay.allocated)
+    {
+        fail("reference to an object that was never allocated");
+    }
+    return replay.allocated - 1 - distance;
+}
+
+static void replay_calls(bool in_destructor);
+
+/// @brief The destructor of every replayed object, plays back the calls made
+///        by the destructor of the original object
+static void replay_destructor(obj *object)
+{
+    if (replay.position >= replay.length || replay.data[replay.position] != REFMEM_TRACE_DESTROY)
+    {
+        fail("diverged, an object was freed that was not freed when recording");
+    }
+    replay.position++;
+    if (replay.objects[read_number()] != object)
+    {
+        fail("diverged, objects were freed in a different order than when recording");
+    }
+    replay_calls(true);
+}
+
+static void replay_allocate(void)
+{
+    size_t bytes = read_varint();
+    if (replay.allocated == replay.capacity)
+    {
+        replay.capacity = replay.capacity ? replay.capacity * 2 : 1024;
+        replay.objects = realloc(replay.objects, replay.capacity * sizeof(obj *));
+        if (!replay.objects)
+        {
+            fail("out of memory");
+        }
+    }
+    /* Numbered before allocating, like when recording, since the sweep in
+       allocate may run destructors that allocate */
+    size_t number = replay.allocated++;
+    replay.objects[number] = allocate(bytes, replay_destructor);
+}
+
+/// @brief Play back a call to retain_many or release_many
+static void replay_many(bool retain_objects)
+{
+    size_t count = read_varint();
+    if (count > replay.length - replay.position)
+    {
+        /* Every object takes at least a byte */
+        fail("unexpected end of trace");
+    }
+    obj **objects = malloc(count * sizeof(obj *));
+    if (count > 0 && !objects)
+    {
+        fail("out of memory");
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        objects[i] = replay.objects[read_number()];
+    }
+    if (retain_objects)
+    {
+        retain_many(objects, count);
+    }
+    else
+    {
+        release_many(objects, count);
+    }
+    free(objects);
+}
+
+/// @brief Play back calls until the end of the trace or, in a destructor,
+///        until the end of the destructor
+static void replay_calls(bool in_destructor)
+{
+    while (replay.position < replay.length)
+    {
+        unsigned char tag = replay.data[replay.position++];
+        replay.calls++;
+        switch (tag)
+        {
+        case REFMEM_TRACE_ALLOCATE:
+            replay_allocate();
+            break;
+        case REFMEM_TRACE_RETAIN:
+            retain(replay.objects[read_number()]);
+            break;
+        case REFMEM_TRACE_RELEASE:
+            release(replay.objects[read_number()]);
+            break;
+        case REFMEM_TRACE_RETAIN_MANY:
+            replay_many(true);
+            break;
+        case REFMEM_TRACE_RELEASE_MANY:
+            replay_many(false);
+            break;
+        case REFMEM_TRACE_DEALLOCATE:
+            deallocate(replay.objects[read_number()]);
+            break;
+        case REFMEM_TRACE_CLEANUP:
+            cleanup();
+            break;
+        case REFMEM_TRACE_LIMIT:
+        {
+            uint64_t limit = read_varint();
+            set_cascade_limit(limit == 0 ? SIZE_MAX : (size_t)(limit - 1));
+            break;
+        }
+        case REFMEM_TRACE_SHUTDOWN:
+            shutdown();
+            break;
+        case REFMEM_TRACE_FREEZE:
+            refmem_freeze();
+            break;
+        case REFMEM_TRACE_REALLOCATE:
+        {
+            size_t number = read_number();
+            replay.objects[number] = reallocate(replay.objects[number], read_varint());
+            if (!replay.objects[number])
+            {
+                fail("out of memory");
+            }
+            break;
+        }
+        case REFMEM_TRACE_DESTROYED:
+            replay.calls--;
+            if (!in_destructor)
+            {
+                fail("end of a destructor outside of a destructor");
+            }
+            return;
+        case REFMEM_TRACE_END:
+            replay.calls--;
+            if (in_destructor)
+            {
+                fail("trace ends inside a destructor");
+            }
+            if (read_varint() != replay.allocated)
+            {
+                fail("object count does not match the trace");
+            }
+            return;
+        case REFMEM_TRACE_DESTROY:
+            replay.position--;
+            fail("diverged, an object was not freed that was freed when recording");
+            break;
+        default:
+            replay.position--;
+            fail("unknown record");
+        }
+    }
+    fail("trace is truncated");
+}
+
+static unsigned char *read_file(const char *path, size_t *length)
+{
+    FILE *in = fopen(path, "rb");
+    if (!in)
+    {
+        perror(path);
+        return NULL;
+    }
+    size_t capacity = 1 << 16;
+    unsigned char *data = malloc(capacity);
+    *length = 0;
+    size_t n;
+    while (data && (n = fread(data + *length, 1, capacity - *length, in)) > 0)
+    {
+        *length += n;
+        if (*length == capacity)
+        {
+            capacity *= 2;
+            unsigned char *grown = realloc(data, capacity);
+            if (!grown)
+            {
+                free(data);
+            }
+            data = grown;
+        }
+    }
+    fclose(in);
+    if (!data)
+    {
+        fprintf(stderr, "%s: out of memory\n", path);
+    }
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s trace-file\n", argv[0]);
+        return 2;
+    }
+
+    unsigned char *data = read_file(argv[1], &replay.length);
+    if (!data)
+    {
+        return 1;
+    }
+    replay.data = data;
+    if (replay.length < 5 || memcmp(data, REFMEM_TRACE_MAGIC, 4) != 0)
+    {
+        fail("not a refmem trace");
+    }
+    replay.position = 4;
+    if (read_varint() != REFMEM_TRACE_VERSION)
+    {
+        fail("unsupported trace version");
+    }
+
+    refmem_pause_reset();
+    uint64_t start = refmem_now_ns();
+    replay_calls(false);
+    uint64_t elapsed = refmem_now_ns() - start;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double seconds = elapsed / 1e9;
+    printf("calls: %llu objects: %zu time: %.3f s throughput: %.0f calls/s peak rss: %ld KiB\n",
+           (unsigned long long)replay.calls, replay.allocated, seconds,
+           seconds > 0 ? replay.calls / seconds : 0.0, usage.ru_maxrss);
+    refmem_pause_dump(stdout);
+
+    shutdown();
+    free(replay.objects);
+    free(data);
+    return 0;
+}